@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -22,34 +22,107 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "memstat.h"
 
-struct {
+// Cached blocks are found through a hash table keyed by
+// (dev, blockno); each bucket has its own lock, so lookups of
+// different blocks on different CPUs don't contend. A bucket's
+// lock protects its chain and the refcnt of the buffers on it.
+//
+// Buffers are recycled by a clock (second chance) sweep over
+// all of them: brelse() sets b->used, and the sweep passes over
+// a buffer once, clearing used, before taking it. The sweep is
+// serialized by bcache.lock, which is also what makes it safe
+// for it to hold two bucket locks at once.
+//
+// The number of buffers is chosen at boot from the amount of
+// free memory; see binit().
+#define NBUCKET 61
+
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *head;   // chain through buf.next
+};
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+struct {
+  struct spinlock lock; // serializes eviction; protects hand
+  struct bucket bucket[NBUCKET];
+  struct buf *hand;     // clock hand, on the ring through buf.clock
+  int nbuf;
+
+  int npinned;      // buffers held in the cache by bpin()
 } bcache;
 
+static struct bucket *
+hashbucket(uint dev, uint blockno)
+{
+  return &bcache.bucket[(dev * 31 + blockno) % NBUCKET];
+}
+
+// take a page from kalloc for the buffer cache.
+static char *
+bpage(void)
+{
+  char *p;
+
+  if((p = kalloctype(KMEM_BUF)) == 0)
+    panic("binit: out of memory");
+  memset(p, 0, PGSIZE);
+  return p;
+}
+
+// Allocate the buffers: BUFPCT percent of free memory, but at
+// least NBUF (the log needs that many) and no more than FSSIZE,
+// since there's no use caching more blocks than the disk holds.
+// Buffer headers and data are carved out of separate pages.
 void
 binit(void)
 {
-  struct buf *b;
+  struct buf *b, *last;
+  struct memstat st;
+  char *hdr = 0, *data = 0;
+  int i, n, nhdr = 0, ndata = 0;
 
   initlock(&bcache.lock, "bcache");
+  for(i = 0; i < NBUCKET; i++)
+    initlock(&bcache.bucket[i].lock, "bcache.bucket");
+
+  kmemstat(&st);
+  n = st.free * (PGSIZE / BSIZE) * BUFPCT / 100;
+  if(n < NBUF)
+    n = NBUF;
+  if(n > FSSIZE)
+    n = FSSIZE;
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+  // All buffers start out unused in bucket 0; no real block
+  // is on dev 0, so lookups never match them.
+  last = 0;
+  for(i = 0; i < n; i++){
+    if(nhdr == 0){
+      hdr = bpage();
+      nhdr = PGSIZE / sizeof(struct buf);
+    }
+    if(ndata == 0){
+      data = bpage();
+      ndata = PGSIZE / BSIZE;
+    }
+    b = (struct buf *)hdr;
+    hdr += sizeof(struct buf);
+    nhdr--;
+    b->data = (uchar *)data;
+    data += BSIZE;
+    ndata--;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->next = bcache.bucket[0].head;
+    bcache.bucket[0].head = b;
+    if(last)
+      last->clock = b;
+    else
+      bcache.hand = b;
+    last = b;
   }
+  last->clock = bcache.hand;
+  bcache.nbuf = n;
 }
 
 // Look through buffer cache for block on device dev.
@@ -58,32 +131,72 @@ binit(void)
 static struct buf*
 bget(uint dev, uint blockno)
 {
-  struct buf *b;
+  struct bucket *bk = hashbucket(dev, blockno);
+  struct bucket *vbk;
+  struct buf *b, **pp;
+  int i;
 
-  acquire(&bcache.lock);
+  acquire(&bk->lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = bk->head; b; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
+      release(&bk->lock);
+      acquiresleep(&b->lock);
+      return b;
+    }
+  }
+  release(&bk->lock);
+
+  // Not cached. Lock order is bcache.lock, then this bucket,
+  // then the victim's bucket. Someone else may have cached
+  // the block while no lock was held, so look again.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  for(b = bk->head; b; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      b->refcnt++;
+      release(&bk->lock);
       release(&bcache.lock);
       acquiresleep(&b->lock);
       return b;
     }
   }
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
+  // Recycle an unused buffer, giving recently used ones
+  // a second chance. Two trips round the clock are enough
+  // to find one if any buffer is unused.
+  for(i = 0; i < 2*bcache.nbuf; i++){
+    b = bcache.hand;
+    bcache.hand = b->clock;
+    vbk = hashbucket(b->dev, b->blockno);
+    if(vbk != bk)
+      acquire(&vbk->lock);
+    if(b->disk){
+      // a readahead is still filling b->data.
+    } else if(b->refcnt == 0 && b->used){
+      b->used = 0;
+    } else if(b->refcnt == 0){
+      // move b from its bucket to this one.
+      for(pp = &vbk->head; *pp != b; pp = &(*pp)->next)
+        ;
+      *pp = b->next;
+      if(vbk != bk)
+        release(&vbk->lock);
+      b->next = bk->head;
+      bk->head = b;
       b->dev = dev;
       b->blockno = blockno;
       b->valid = 0;
       b->refcnt = 1;
+      release(&bk->lock);
       release(&bcache.lock);
       acquiresleep(&b->lock);
       return b;
     }
+    if(vbk != bk)
+      release(&vbk->lock);
   }
   panic("bget: no buffers");
 }
@@ -95,6 +208,10 @@ bread(uint dev, uint blockno)
   struct buf *b;
 
   b = bget(dev, blockno);
+  if(b->disk){
+    // breadahead() started reading it.
+    virtio_disk_wait(b);
+  }
   if(!b->valid) {
     virtio_disk_rw(b, 0);
     b->valid = 1;
@@ -102,6 +219,50 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Return a locked buf for the indicated block without reading
+// it from disk, for a caller that will overwrite all of b->data.
+struct buf*
+bnoread(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  if(b->disk)
+    virtio_disk_wait(b);
+  b->valid = 1;
+  return b;
+}
+
+// Start reading the n indicated blocks into the cache, if
+// they aren't there already, but don't wait for them. b->valid
+// is set now; bread() waits for b->disk to clear. Adjacent
+// blocks are read with one disk request.
+// Only buffers not yet valid are held across bget() calls;
+// those can't be pinned by the log, so this can't deadlock
+// with a commit holding many buffers.
+void
+breadahead(uint dev, uint *blockno, int n)
+{
+  struct buf *b, *rd[NREADAHEAD];
+  int i, nrd = 0;
+
+  if(n > NREADAHEAD)
+    panic("breadahead");
+  for(i = 0; i < n; i++){
+    b = bget(dev, blockno[i]);
+    if(b->valid){
+      brelse(b);
+    } else {
+      b->valid = 1;
+      rd[nrd++] = b;
+    }
+  }
+  if(nrd > 0)
+    virtio_disk_start(rd, nrd, 0);
+  for(i = 0; i < nrd; i++)
+    brelse(rd[i]);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -111,43 +272,88 @@ bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
+// Start writing the contents of the n bufs in b[] to disk,
+// and return without waiting. They must be locked, and stay
+// locked until bwait(). Lets a caller keep many writes in
+// flight at once; runs of adjacent blocks in b[] are merged
+// into single disk requests.
+void
+bwritestart(struct buf **b, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(!holdingsleep(&b[i]->lock))
+      panic("bwritestart");
+  virtio_disk_start(b, n, 1);
+}
+
+// Wait for a bwritestart() to finish.
+void
+bwait(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwait");
+  virtio_disk_wait(b);
+}
+
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Mark it recently used, for the clock.
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  // b can't change buckets while refcnt > 0.
+  bk = hashbucket(b->dev, b->blockno);
+  acquire(&bk->lock);
   b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+  b->used = 1;
+  release(&bk->lock);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = hashbucket(b->dev, b->blockno);
+
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  __sync_fetch_and_add(&bcache.npinned, 1);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = hashbucket(b->dev, b->blockno);
+
+  acquire(&bk->lock);
   b->refcnt--;
-  release(&bcache.lock);
+  __sync_fetch_and_add(&bcache.npinned, -1);
+  release(&bk->lock);
+}
+
+// Fill in the buffer cache part of a memstat.
+void
+bstat(struct memstat *st)
+{
+  struct bucket *bk;
+  struct buf *b;
+
+  st->nbuf = bcache.nbuf;
+  st->bufinuse = 0;
+  for(bk = bcache.bucket; bk < &bcache.bucket[NBUCKET]; bk++){
+    acquire(&bk->lock);
+    for(b = bk->head; b; b = b->next)
+      if(b->refcnt > 0)
+        st->bufinuse++;
+    release(&bk->lock);
+  }
+  st->bufpinned = bcache.npinned;
 }
 
 
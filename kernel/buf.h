@@ -5,8 +5,10 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
-  uchar data[BSIZE];
+  int used;          // released since the clock last passed?
+  struct buf *next;  // hash bucket chain
+  struct buf *clock; // ring of all buffers, for eviction
+  struct buf *qnext; // next buf in the same disk request
+  uchar *data;       // BSIZE bytes
 };
 
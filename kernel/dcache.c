@@ -0,0 +1,181 @@
+// Directory entry cache.
+//
+// Remembers the results of dirlookup(): for a directory and a
+// name, the inode number the name refers to and the byte offset
+// of its entry, or that the directory has no such name (a
+// negative entry, with inum 0). Path lookups of names that were
+// resolved recently then don't read the directory.
+//
+// Callers hold the directory's sleep-lock, and every change to
+// a directory's entries goes through dirlink() or dirunlink(),
+// which update the cache, so an entry is never stale. When a
+// directory inode is freed, dcachepurge() drops its entries
+// before the inode number can be reused.
+//
+// dcache.lock protects the table, the hash chains, and the
+// LRU list.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+
+#define NDHASH 61
+
+struct dentry {
+  uint dev;
+  uint dir;             // inode number of the directory
+  char name[DIRSIZ];
+  uint inum;            // 0 if the directory has no such name
+  uint off;             // byte offset of the entry in the directory
+  struct dentry *next;  // hash chain
+  struct dentry *lprev; // LRU list; dcache.lru.lnext is newest
+  struct dentry *lnext;
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry dentry[NDENTRY];
+  struct dentry *hash[NDHASH];
+  struct dentry lru;
+} dcache;
+
+static struct dentry **
+dhash(uint dev, uint dir, char *name)
+{
+  uint h = dev * 31 + dir;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return &dcache.hash[h % NDHASH];
+}
+
+static void
+lruremove(struct dentry *d)
+{
+  d->lprev->lnext = d->lnext;
+  d->lnext->lprev = d->lprev;
+}
+
+// Put d at the newest end of the LRU list, or at the oldest
+// end if it holds nothing.
+static void
+lruinsert(struct dentry *d, int keep)
+{
+  struct dentry *at = keep ? &dcache.lru : dcache.lru.lprev;
+
+  d->lnext = at->lnext;
+  d->lprev = at;
+  at->lnext->lprev = d;
+  at->lnext = d;
+}
+
+// Remove d from its hash chain, if it's on one.
+static void
+dunhash(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = dhash(d->dev, d->dir, d->name); *pp; pp = &(*pp)->next){
+    if(*pp == d){
+      *pp = d->next;
+      return;
+    }
+  }
+}
+
+// Find the entry for name in dp. Called with dcache.lock held.
+static struct dentry *
+dfind(struct inode *dp, char *name)
+{
+  struct dentry *d;
+
+  for(d = *dhash(dp->dev, dp->inum, name); d; d = d->next)
+    if(d->dev == dp->dev && d->dir == dp->inum &&
+       namecmp(d->name, name) == 0)
+      return d;
+  return 0;
+}
+
+void
+dcacheinit(void)
+{
+  struct dentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.lru.lnext = &dcache.lru;
+  dcache.lru.lprev = &dcache.lru;
+  for(d = dcache.dentry; d < &dcache.dentry[NDENTRY]; d++)
+    lruinsert(d, 0);
+}
+
+// Look up name in directory dp, which the caller has locked.
+// Return 1 and set *inum and *off if the cache knows the
+// answer; *inum is 0 if dp has no entry for name.
+// Return 0 if the cache doesn't know.
+int
+dcachelookup(struct inode *dp, char *name, uint *inum, uint *off)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dp, name)) == 0){
+    release(&dcache.lock);
+    return 0;
+  }
+  lruremove(d);
+  lruinsert(d, 1);
+  *inum = d->inum;
+  *off = d->off;
+  release(&dcache.lock);
+  return 1;
+}
+
+// Record that name in dp refers to inum, with its entry at
+// offset off, or, if inum is 0, that dp has no entry for name.
+void
+dcacheadd(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dp, name)) == 0){
+    // Recycle the least recently used entry.
+    d = dcache.lru.lprev;
+    dunhash(d);
+    d->dev = dp->dev;
+    d->dir = dp->inum;
+    strncpy(d->name, name, DIRSIZ);
+    d->next = *dhash(d->dev, d->dir, d->name);
+    *dhash(d->dev, d->dir, d->name) = d;
+  }
+  d->inum = inum;
+  d->off = off;
+  lruremove(d);
+  lruinsert(d, 1);
+  release(&dcache.lock);
+}
+
+// Forget every entry of directory dp, which is being freed.
+void
+dcachepurge(struct inode *dp)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.dentry; d < &dcache.dentry[NDENTRY]; d++){
+    if(d->dir == dp->inum && d->dev == dp->dev){
+      dunhash(d);
+      d->dev = 0;
+      d->dir = 0;
+      lruremove(d);
+      lruinsert(d, 0);
+    }
+  }
+  release(&dcache.lock);
+}
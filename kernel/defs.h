@@ -1,7 +1,11 @@
 struct buf;
 struct context;
+struct cpustat;
 struct file;
 struct inode;
+struct lockstat;
+struct logstat;
+struct memstat;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -16,6 +20,11 @@ void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+void            bstat(struct memstat*);
+void            breadahead(uint, uint*, int);
+struct buf*     bnoread(uint, uint);
+void            bwritestart(struct buf**, int);
+void            bwait(struct buf*);
 
 // console.c
 void            consoleinit(void);
@@ -35,10 +44,34 @@ int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
 int             kfileread(struct file*, uint64, int n);
 int             kfilewrite(struct file*, uint64, int n);
+// dcache.c
+void            dcacheinit(void);
+int             dcachelookup(struct inode*, char*, uint*, uint*);
+void            dcacheadd(struct inode*, char*, uint, uint);
+void            dcachepurge(struct inode*);
+
+// pcache.c
+void            pcacheinit(void);
+uint64          pcacheget(struct inode*, uint);
+void            pcachedup(uint64);
+void            pcacheput(uint64);
+void            pcachewrite(struct inode*, uint, void*, uint);
+void            pcachetrunc(struct inode*);
+
+// mmap.c
+uint64          mmap(uint64, int, int, struct file*, uint);
+void            mmaptext(struct proc*, struct inode*, uint64, uint64, uint);
+int             munmap(uint64, uint64);
+int             mmapfault(struct proc*, uint64, int);
+void            mmapprefault(uint64, uint64, int);
+void            munmapall(struct proc*);
+int             mmapcopy(struct proc*, struct proc*);
+
 // fs.c
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
+void            dirunlink(struct inode*, char*, uint);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit();
@@ -58,6 +91,7 @@ int		        createSwapFile(struct proc* p);
 int	          	readFromSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size);
 int		        writeToSwapFile(struct proc* p, char* buffer, uint placeOnFile, uint size);
 int		        removeSwapFile(struct proc* p);
+void            swapinit(void);
 
 // ramdisk.c
 void            ramdiskinit(void);
@@ -66,20 +100,28 @@ void            ramdiskrw(struct buf*);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kalloctype(int);
 void            kfree(void *);
+void            kmemretype(void *, int);
 void            kinit(void);
+void            kmemstat(struct memstat*);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
+void            begin_opn(int);
 void            end_op(void);
+void            log_flush(void);
+int             logmaxop(void);
+void            logstat(struct logstat*);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+int             piperead(struct pipe*, uint64, int, int);
+int             pipewrite(struct pipe*, uint64, int, int);
+int             pipefcntl(struct file*, int, int);
 
 // printf.c
 void            printf(char*, ...);
@@ -90,17 +132,24 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             spawn(char*, char**, struct file**);
 int             growproc(int);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+void            kproc(char*, void (*)(void));
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
 void            procinit(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+int             schedstat(struct cpustat*, int);
+int             setpriority(int, int, int);
+int             nice(int);
+int             needresched(void);
+void            setrunnable(struct proc*);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
@@ -111,6 +160,9 @@ int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
 
+// start.c
+int             timerfired(void);
+
 // swtch.S
 void            swtch(struct context*, struct context*);
 
@@ -121,6 +173,7 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+int             lockstat(int, struct lockstat*);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
@@ -172,6 +225,7 @@ pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
+uint64          uvmlazy(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
@@ -192,6 +246,8 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_start(struct buf **, int, int);
+void            virtio_disk_wait(struct buf *);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
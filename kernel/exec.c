@@ -15,8 +15,10 @@ exec(char *path, char **argv)
   char *s, *last;
   int i, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG+1], stackbase;
+  uint64 textva = 0, textsz = 0;
+  uint textoff = 0;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *tip = 0;
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
@@ -27,6 +29,9 @@ exec(char *path, char **argv)
     end_op();
     return -1;
   }
+  // Load outside a transaction: loading can evict pages, and
+  // the first eviction creates the swap file, in its own.
+  end_op();
   ilock(ip);
 
   // Check ELF header
@@ -48,16 +53,33 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
+    if(ph.vaddr % PGSIZE != 0)
+      goto bad;
     uint64 sz1;
+    if((ph.flags & ELF_PROG_FLAG_WRITE) == 0 && textsz == 0 &&
+       ph.memsz > 0 && ph.memsz == ph.filesz && ph.off % PGSIZE == 0 &&
+       ph.vaddr >= PGROUNDUP(sz) && ph.vaddr + ph.memsz <= MMAPBASE){
+      // Read-only text: leave it to be faulted in from the
+      // page cache, shared with other processes running it.
+      if((sz1 = uvmlazy(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
+        goto bad;
+      sz = sz1;
+      textva = ph.vaddr;
+      textsz = ph.memsz;
+      textoff = ph.off;
+      continue;
+    }
     if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
       goto bad;
     sz = sz1;
-    if(ph.vaddr % PGSIZE != 0)
-      goto bad;
     if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
-  iunlockput(ip);
+  if(textsz)
+    tip = idup(ip);
+  iunlock(ip);
+  begin_op();
+  iput(ip);
   end_op();
   ip = 0;
 
@@ -109,6 +131,9 @@ exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  munmapall(p);
+  if(tip)
+    mmaptext(p, tip, textva, textsz, textoff);
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
   p->sz = sz;
@@ -123,7 +148,14 @@ exec(char *path, char **argv)
   if(pagetable)
     proc_freepagetable(pagetable, sz);
   if(ip){
-    iunlockput(ip);
+    iunlock(ip);
+    begin_op();
+    iput(ip);
+    end_op();
+  }
+  if(tip){
+    begin_op();
+    iput(tip);
     end_op();
   }
   return -1;
@@ -3,3 +3,16 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+
+// mmap() protections and flags
+#define PROT_READ   0x1
+#define PROT_WRITE  0x2
+#define PROT_EXEC   0x4
+
+#define MAP_SHARED  0x01
+#define MAP_PRIVATE 0x02
+
+// fcntl() commands, for pipes
+#define F_GETPIPE_SZ   1  // buffer size in bytes
+#define F_SETPIPE_SZ   2  // resize, rounded up to a power of two pages
+#define F_SETPIPE_GIFT 3  // arg != 0: this end moves whole pages, see pipe.c
@@ -4,6 +4,7 @@ struct file {
   char readable;
   char writable;
   struct pipe *pipe; // FD_PIPE
+  char gift;         // FD_PIPE: F_SETPIPE_GIFT
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
   short major;       // FD_DEVICE
@@ -18,6 +19,9 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *next; // hash chain
+  struct inode *lprev; // LRU list of unreferenced inodes
+  struct inode *lnext;
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -26,7 +30,14 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+2];
+
+  uint ranext;        // block after the last one readi() read
+  uint raend;         // blocks before this have been read ahead
+  uint ebn;           // file blocks [ebn, ebn+elen) are at
+  uint eaddr;         // disk blocks [eaddr, eaddr+elen); see bmap()
+  uint elen;
+  uint goal;          // where to try to allocate its next block
 };
 
 // map major device number to device functions.
@@ -20,8 +20,10 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "memstat.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -37,6 +39,10 @@ readsb(int dev, struct superblock *sb)
   brelse(bp);
 }
 
+static void bsuminit(int);
+static void itableinit(void);
+static void igrow(int);
+
 // Init fs
 void
 fsinit(int dev) {
@@ -44,44 +50,154 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  bsuminit(dev);
+  itableinit();
 }
 
-// Zero a block.
+// Zero a block. There's no need to read it first.
 static void
 bzero(int dev, int bno)
 {
   struct buf *bp;
 
-  bp = bread(dev, bno);
+  bp = bnoread(dev, bno);
   memset(bp->data, 0, BSIZE);
   log_write(bp);
   brelse(bp);
 }
 
 // Blocks.
+//
+// bsum summarizes the free bitmap in memory: how many blocks
+// each bitmap block has free, so balloc() never reads a full
+// one, and a rotor where the last allocation without a goal
+// ended, so the next one doesn't rescan the used blocks
+// before it. The bitmap block's buffer lock serializes
+// allocations within it; bsum.lock protects the counts.
 
-// Allocate a zeroed disk block.
-static uint
-balloc(uint dev)
+#define NBITMAP (FSSIZE/BPB + 1)
+
+struct {
+  struct spinlock lock;
+  uint nfree[NBITMAP];
+  uint rotor;
+} bsum;
+
+// index of the lowest zero bit in x, which isn't all ones.
+static int
+lowzero(uint64 x)
+{
+  int i = 0;
+
+  while((x & 0xff) == 0xff){
+    x >>= 8;
+    i += 8;
+  }
+  while(x & 1){
+    x >>= 1;
+    i++;
+  }
+  return i;
+}
+
+// Find a clear bit in bitmap block data, at or after bit
+// from and before bit to, a word at a time. Return -1 if
+// there isn't one.
+static int
+bfind(uchar *data, int from, int to)
+{
+  uint64 *w = (uint64*)data;
+  uint64 x;
+  int i, bit;
+
+  if(from >= to)
+    return -1;
+  i = from / 64;
+  x = w[i] | (((uint64)1 << (from % 64)) - 1);  // skip bits before from
+  for(;;){
+    if(x != ~(uint64)0){
+      bit = i*64 + lowzero(x);
+      return bit < to ? bit : -1;
+    }
+    if(++i * 64 >= to)
+      return -1;
+    x = w[i];
+  }
+}
+
+// Count the free blocks in each bitmap block.
+static void
+bsuminit(int dev)
 {
-  int b, bi, m;
   struct buf *bp;
+  uint b, bi;
 
-  bp = 0;
+  if(sb.size > NBITMAP*BPB)
+    panic("bsuminit: file system too big");
+  initlock(&bsum.lock, "bsum");
   for(b = 0; b < sb.size; b += BPB){
     bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
-    }
+    for(bi = 0; bi < BPB && b + bi < sb.size; bi++)
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0)
+        bsum.nfree[b / BPB]++;
     brelse(bp);
   }
+}
+
+// Look for a free block in [from, to), which lie in one bitmap
+// block. If found, mark it in use and return it; else 0.
+static uint
+ballocin(uint dev, uint from, uint to)
+{
+  struct buf *bp;
+  uint base = from - from % BPB;
+  int bi;
+
+  if(bsum.nfree[from / BPB] == 0)  // a hint; checked again below
+    return 0;
+  bp = bread(dev, BBLOCK(from, sb));
+  bi = bfind(bp->data, from - base, to - base);
+  if(bi < 0){
+    brelse(bp);
+    return 0;
+  }
+  bp->data[bi/8] |= 1 << (bi % 8);  // Mark block in use.
+  log_write(bp);
+  brelse(bp);
+
+  acquire(&bsum.lock);
+  bsum.nfree[from / BPB]--;
+  bsum.rotor = base + bi + 1;
+  release(&bsum.lock);
+  return base + bi;
+}
+
+// Allocate a disk block, preferably goal, or else the first
+// free one after it. With no goal, start at the rotor.
+// The block is not zeroed.
+static uint
+balloc(uint dev, uint goal)
+{
+  uint b, start, end, addr;
+
+  if(goal == 0 || goal >= sb.size)
+    goal = bsum.rotor < sb.size ? bsum.rotor : 0;
+
+  // from goal to the end of the disk, then wrap around.
+  for(start = goal; start < sb.size; start = end){
+    end = start - start % BPB + BPB;
+    if(end > sb.size)
+      end = sb.size;
+    if((addr = ballocin(dev, start, end)) != 0)
+      return addr;
+  }
+  for(b = 0; b < goal; b = end){
+    end = b + BPB;
+    if(end > goal)
+      end = goal;
+    if((addr = ballocin(dev, b, end)) != 0)
+      return addr;
+  }
   panic("balloc: out of blocks");
 }
 
@@ -100,6 +216,10 @@ bfree(int dev, uint b)
   bp->data[bi/8] &= ~m;
   log_write(bp);
   brelse(bp);
+
+  acquire(&bsum.lock);
+  bsum.nfree[b / BPB]++;
+  release(&bsum.lock);
 }
 
 // Inodes.
@@ -128,7 +248,7 @@ bfree(int dev, uint b)
 //   the reference and link counts have fallen to zero.
 //
 // * Referencing in table: an entry in the inode table
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
+//   may be recycled if ip->ref is zero. Otherwise ip->ref tracks
 //   the number of in-memory pointers to the entry (open
 //   files and current directories). iget() finds or
 //   creates a table entry and increments its ref; iput()
@@ -138,7 +258,9 @@ bfree(int dev, uint b)
 //   table entry is only correct when ip->valid is 1.
 //   ilock() reads the inode from
 //   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ip->valid if it frees the inode on disk. An entry
+//   whose ref has fallen to zero stays valid, so a later
+//   iget() of the same inode needn't read it again.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -162,31 +284,124 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
+// The table is a hash table keyed by (dev, inum). Entries with
+// ref zero are also on an LRU list, most recently released
+// first; iget() recycles the least recently used one. Entries
+// that hold nothing worth keeping (never used, or freed on
+// disk) go on the far end of the list, so they're taken first.
+//
 // The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// entries. Since ip->ref indicates whether an entry may be
+// recycled, and ip->dev and ip->inum indicate which i-node an
+// entry holds, one must hold itable.lock while using any of
+// those fields, or the hash chains and the LRU list.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
+// dev, inum, and the list links.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
+//
+// The number of entries is chosen when the file system is
+// mounted; see itableinit().
+#define NIHASH 31
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inode *hash[NIHASH];  // chains through inode.next
+  struct inode lru;            // head of the LRU list; lnext is newest
+  int ninode;
 } itable;
 
+static struct inode **
+ihash(uint dev, uint inum)
+{
+  return &itable.hash[(dev * 31 + inum) % NIHASH];
+}
+
+// Remove ip from its hash chain, if it's on one.
+static void
+iunhash(struct inode *ip)
+{
+  struct inode **pp;
+
+  for(pp = ihash(ip->dev, ip->inum); *pp; pp = &(*pp)->next){
+    if(*pp == ip){
+      *pp = ip->next;
+      return;
+    }
+  }
+}
+
+static void
+lruremove(struct inode *ip)
+{
+  ip->lprev->lnext = ip->lnext;
+  ip->lnext->lprev = ip->lprev;
+}
+
+// Put ip on the LRU list: at the newest end if it's worth
+// keeping, else at the end iget() recycles from first.
+static void
+lruinsert(struct inode *ip, int keep)
+{
+  struct inode *at = keep ? &itable.lru : itable.lru.lprev;
+
+  ip->lnext = at->lnext;
+  ip->lprev = at;
+  at->lnext->lprev = ip;
+  at->lnext = ip;
+}
+
 void
 iinit()
 {
-  int i = 0;
-  
   initlock(&itable.lock, "itable");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
+  itable.lru.lnext = &itable.lru;
+  itable.lru.lprev = &itable.lru;
+  igrow(NINODE);
+}
+
+// Add entries to the inode table until it has n.
+static void
+igrow(int n)
+{
+  struct inode *ip = 0;
+  char *page;
+  int per = PGSIZE / sizeof(struct inode);
+  int i;
+
+  for(i = 0; itable.ninode < n; i++){
+    if(i % per == 0){
+      if((page = kalloctype(KMEM_INODE)) == 0)
+        panic("igrow: out of memory");
+      memset(page, 0, PGSIZE);
+      ip = (struct inode *)page;
+    }
+    initsleeplock(&ip->lock, "inode");
+    acquire(&itable.lock);
+    lruinsert(ip, 0);
+    itable.ninode++;
+    release(&itable.lock);
+    ip++;
   }
 }
 
+// Size the inode table once the superblock is known: one entry
+// per inode on the disk, if INODEPCT percent of free memory
+// allows. iinit() made the first NINODE, enough for userinit()
+// to look up "/" before the file system is mounted.
+static void
+itableinit(void)
+{
+  struct memstat st;
+  int n;
+
+  kmemstat(&st);
+  n = st.free * (PGSIZE / sizeof(struct inode)) * INODEPCT / 100;
+  if(n > sb.ninodes)
+    n = sb.ninodes;
+  igrow(n);
+}
+
 static struct inode* iget(uint dev, uint inum);
 
 // Allocate an inode on device dev.
@@ -242,31 +457,34 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode **head = ihash(dev, inum);
+  struct inode *ip;
 
   acquire(&itable.lock);
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  for(ip = *head; ip; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        lruremove(ip);
       release(&itable.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
+  // Recycle the least recently used entry.
+  ip = itable.lru.lprev;
+  if(ip == &itable.lru)
     panic("iget: no inodes");
+  lruremove(ip);
+  iunhash(ip);
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->next = *head;
+  *head = ip;
   release(&itable.lock);
 
   return ip;
@@ -295,6 +513,7 @@ ilock(struct inode *ip)
     panic("ilock");
 
   acquiresleep(&ip->lock);
+  myproc()->nilock++;
 
   if(ip->valid == 0){
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
@@ -306,6 +525,10 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ip->ranext = 0;
+    ip->raend = 0;
+    ip->elen = 0;
+    ip->goal = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -319,12 +542,13 @@ iunlock(struct inode *ip)
   if(ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)
     panic("iunlock");
 
+  myproc()->nilock--;
   releasesleep(&ip->lock);
 }
 
 // Drop a reference to an in-memory inode.
 // If that was the last reference, the inode table entry can
-// be recycled.
+// be recycled, but it stays cached until it is.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -343,6 +567,8 @@ iput(struct inode *ip)
 
     release(&itable.lock);
 
+    if(ip->type == T_DIR)
+      dcachepurge(ip);
     itrunc(ip);
     ip->type = 0;
     iupdate(ip);
@@ -353,7 +579,8 @@ iput(struct inode *ip)
     acquire(&itable.lock);
   }
 
-  ip->ref--;
+  if(--ip->ref == 0)
+    lruinsert(ip, ip->valid);
   release(&itable.lock);
 }
 
@@ -370,19 +597,80 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT]. The next NDINDIRECT
+// blocks are listed in NINDIRECT more blocks, whose numbers
+// are listed in block ip->addrs[NDIRECT+1].
+//
+// ip->ebn, eaddr and elen cache the last run of file blocks
+// found to be contiguous on disk, so a sequential reader
+// looks up the indirect blocks once per run, not per block.
+
+// remember that file block bn is at a[i], along with any
+// following file blocks that are contiguous on disk.
+static void
+setextent(struct inode *ip, uint bn, uint *a, int i, int n)
+{
+  int j;
+
+  for(j = i + 1; j < n && a[j] != 0 && a[j] == a[j-1] + 1; j++)
+    ;
+  ip->ebn = bn;
+  ip->eaddr = a[i];
+  ip->elen = j - i;
+}
+
+// allocate a block for ip, after a[i-1] if that's a block,
+// else after the last block allocated for ip.
+static uint
+allocfor(struct inode *ip, uint *a, int i)
+{
+  uint addr;
+
+  addr = balloc(ip->dev, i > 0 && a[i-1] ? a[i-1] + 1 : ip->goal);
+  ip->goal = addr + 1;
+  return addr;
+}
+
+// allocate a zeroed block for ip, for an indirect block.
+static uint
+allocindirect(struct inode *ip, uint *a, int i)
+{
+  uint addr = allocfor(ip, a, i);
+
+  bzero(ip->dev, addr);
+  return addr;
+}
+
+// allocate a data block for ip. if fresh is 0, zero it;
+// else the caller will fill it, and *fresh is set.
+static uint
+allocdata(struct inode *ip, uint *a, int i, int *fresh)
+{
+  uint addr = allocfor(ip, a, i);
+
+  if(fresh)
+    *fresh = 1;
+  else
+    bzero(ip->dev, addr);
+  return addr;
+}
 
 // Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// If there is no such block, bmap allocates one, zeroed
+// unless fresh is non-zero (see allocdata()).
 static uint
-bmap(struct inode *ip, uint bn)
+bmap(struct inode *ip, uint bn, int *fresh)
 {
-  uint addr, *a;
+  uint addr, *a, fbn = bn;
   struct buf *bp;
 
+  if(bn >= ip->ebn && bn < ip->ebn + ip->elen)
+    return ip->eaddr + (bn - ip->ebn);
+
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = allocdata(ip, ip->addrs, bn, fresh);
+    setextent(ip, fbn, ip->addrs, bn, NDIRECT);
     return addr;
   }
   bn -= NDIRECT;
@@ -390,13 +678,38 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT] = addr = allocindirect(ip, ip->addrs, NDIRECT);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+      a[bn] = addr = allocdata(ip, a, bn, fresh);
       log_write(bp);
     }
+    setextent(ip, fbn, a, bn, NINDIRECT);
+    brelse(bp);
+    return addr;
+  }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    // Load double-indirect block, then the indirect
+    // block it points to, allocating if necessary.
+    if((addr = ip->addrs[NDIRECT+1]) == 0)
+      ip->addrs[NDIRECT+1] = addr = allocindirect(ip, ip->addrs, NDIRECT+1);
+    bp = bread(ip->dev, addr);
+    a = (uint*)bp->data;
+    if((addr = a[bn / NINDIRECT]) == 0){
+      a[bn / NINDIRECT] = addr = allocindirect(ip, a, 0);
+      log_write(bp);
+    }
+    brelse(bp);
+    bp = bread(ip->dev, addr);
+    a = (uint*)bp->data;
+    if((addr = a[bn % NINDIRECT]) == 0){
+      a[bn % NINDIRECT] = addr = allocdata(ip, a, bn % NINDIRECT, fresh);
+      log_write(bp);
+    }
+    setextent(ip, fbn, a, bn % NINDIRECT, NINDIRECT);
     brelse(bp);
     return addr;
   }
@@ -404,15 +717,37 @@ bmap(struct inode *ip, uint bn)
   panic("bmap: out of range");
 }
 
+// Free the blocks listed in indirect block addr, and addr.
+// If depth > 1, they are indirect blocks themselves.
+static void
+ifree(uint dev, uint addr, int depth)
+{
+  struct buf *bp;
+  uint *a;
+  int j;
+
+  bp = bread(dev, addr);
+  a = (uint*)bp->data;
+  for(j = 0; j < NINDIRECT; j++){
+    if(a[j]){
+      if(depth > 1)
+        ifree(dev, a[j], depth - 1);
+      else
+        bfree(dev, a[j]);
+    }
+  }
+  brelse(bp);
+  bfree(dev, addr);
+}
+
 // Truncate inode (discard contents).
 // Caller must hold ip->lock.
 void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i;
 
+  pcachetrunc(ip);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -421,17 +756,16 @@ itrunc(struct inode *ip)
   }
 
   if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
-    }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
+    ifree(ip->dev, ip->addrs[NDIRECT], 1);
     ip->addrs[NDIRECT] = 0;
   }
 
+  if(ip->addrs[NDIRECT+1]){
+    ifree(ip->dev, ip->addrs[NDIRECT+1], 2);
+    ip->addrs[NDIRECT+1] = 0;
+  }
+
+  ip->elen = 0;
   ip->size = 0;
   iupdate(ip);
 }
@@ -448,6 +782,34 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// readi() just read blocks [bn, next) of ip. If that
+// continues where the last read left off (or re-reads its
+// last, partial, block), keep the next NREADAHEAD blocks
+// in flight so the disk works while the caller does.
+static void
+readahead(struct inode *ip, uint bn, uint next)
+{
+  uint b, end, blocks[NREADAHEAD];
+  int n = 0;
+
+  if(bn != ip->ranext && bn + 1 != ip->ranext){
+    ip->ranext = next;
+    ip->raend = next;
+    return;
+  }
+  ip->ranext = next;
+
+  end = next + NREADAHEAD;
+  if(end > (ip->size + BSIZE - 1) / BSIZE)
+    end = (ip->size + BSIZE - 1) / BSIZE;
+  for(b = max(next, ip->raend); b < end; b++)
+    blocks[n++] = bmap(ip, b, 0);
+  if(n > 0)
+    breadahead(ip->dev, blocks, n);
+  if(end > ip->raend)
+    ip->raend = end;
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
@@ -455,7 +817,7 @@ stati(struct inode *ip, struct stat *st)
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, bn;
   struct buf *bp;
 
   if(off > ip->size || off + n < off)
@@ -463,8 +825,9 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   if(off + n > ip->size)
     n = ip->size - off;
 
+  bn = off / BSIZE;
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    bp = bread(ip->dev, bmap(ip, off/BSIZE, 0));
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
       brelse(bp);
@@ -473,6 +836,8 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     }
     brelse(bp);
   }
+  if(tot != -1 && tot > 0)
+    readahead(ip, bn, (off - 1) / BSIZE + 1);
   return tot;
 }
 
@@ -486,8 +851,9 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 int
 writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, addr;
   struct buf *bp;
+  int fresh;
 
   if(off > ip->size || off + n < off)
     return -1;
@@ -495,12 +861,22 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     return -1;
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
+    // a new block that this write fills needn't be zeroed
+    // first, or read.
+    fresh = 0;
+    addr = bmap(ip, off/BSIZE, m == BSIZE ? &fresh : 0);
+    bp = fresh ? bnoread(ip->dev, addr) : bread(ip->dev, addr);
     if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
+      if(fresh){
+        // don't leave what the buffer held before in the file.
+        memset(bp->data, 0, BSIZE);
+        log_write(bp);
+      }
       brelse(bp);
       break;
     }
+    pcachewrite(ip, off, bp->data + (off % BSIZE), m);
     log_write(bp);
     brelse(bp);
   }
@@ -524,32 +900,146 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// A directory is an array of dirents, with free slots having
+// inum 0. Small ones are linear: entries go in the first free
+// slot, and lookups read the whole directory. mkfs makes the
+// root directory hashed, so it stays quick to search however
+// many files it holds: a name's entry is in the chain of
+// blocks that starts at block dirhash(name) % nbucket, linked
+// through the dirtail in the last slot of each block. Block 0's
+// dirtail says which format a directory has.
+//
+// Either way, code that just wants every entry, like ls and
+// isdirempty(), can read the directory as an array.
+
+// must match dirhash() in mkfs.
+static uint
+dirhash(char *name)
+{
+  uint h = 0;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return h;
+}
+
+// Read the dirtail of block b of dp. Return 1 if it is one,
+// which block 0's is only in a hashed directory.
+static int
+dirtail(struct inode *dp, uint b, struct dirtail *t)
+{
+  uint off = b*BSIZE + BSIZE - sizeof(*t);
+
+  if(off + sizeof(*t) > dp->size)
+    return 0;
+  if(readi(dp, 0, (uint64)t, off, sizeof(*t)) != sizeof(*t))
+    panic("dirtail read");
+  return t->inum == 0 && t->magic[0] == DIRMAGIC0 && t->magic[1] == DIRMAGIC1;
+}
+
+// Search the n entries of dp starting at offset off for name.
+// Return its inum and set *poff, or return 0. If pfree isn't
+// 0, set *pfree to the offset of the first free slot passed,
+// if *pfree is -1.
+static uint
+dirscan(struct inode *dp, char *name, uint off, uint n, uint *poff, uint *pfree)
+{
+  struct dirent de;
+
+  for(; n > 0; n--, off += sizeof(de)){
+    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+      panic("dirscan read");
+    if(de.inum == 0){
+      if(pfree && *pfree == -1)
+        *pfree = off;
+      continue;
+    }
+    if(namecmp(name, de.name) == 0){
+      *poff = off;
+      return de.inum;
+    }
+  }
+  return 0;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
-  struct dirent de;
+  uint off, inum, b;
+  struct dirtail t;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-    if(de.inum == 0)
-      continue;
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      if(poff)
-        *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
+  if(dcachelookup(dp, name, &inum, &off)){
+    if(inum == 0)
+      return 0;
+    if(poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  }
+
+  if(dirtail(dp, 0, &t)){
+    // search the name's chain.
+    b = dirhash(name) % t.nbucket;
+    for(;;){
+      if((inum = dirscan(dp, name, b*BSIZE, DPB-1, &off, 0)) != 0)
+        break;
+      if(!dirtail(dp, b, &t))
+        panic("dirlookup: no dirtail");
+      if((b = t.next) == 0)
+        break;
     }
+  } else {
+    inum = dirscan(dp, name, 0, dp->size / sizeof(struct dirent), &off, 0);
   }
 
-  return 0;
+  if(inum == 0){
+    dcacheadd(dp, name, 0, 0);
+    return 0;
+  }
+  // entry matches path element
+  if(poff)
+    *poff = off;
+  dcacheadd(dp, name, inum, off);
+  return iget(dp->dev, inum);
+}
+
+// Find a free slot for name in hashed directory dp, adding a
+// block to the end of name's chain if the chain is full.
+static uint
+dirslot(struct inode *dp, char *name, uint nbucket)
+{
+  uint b, nb, off, free = -1;
+  struct dirtail t;
+
+  b = dirhash(name) % nbucket;
+  for(;;){
+    dirscan(dp, name, b*BSIZE, DPB-1, &off, &free);
+    if(free != -1)
+      return free;
+    if(!dirtail(dp, b, &t))
+      panic("dirslot: no dirtail");
+    if(t.next == 0)
+      break;
+    b = t.next;
+  }
+
+  // The new block's entries read as free once writei()
+  // allocates it, since bmap() zeroes it.
+  nb = dp->size / BSIZE;
+  t.next = 0;
+  dp->size = nb*BSIZE + BSIZE - sizeof(t);
+  if(writei(dp, 0, (uint64)&t, dp->size, sizeof(t)) != sizeof(t))
+    panic("dirslot: writei");
+  t.next = nb;
+  off = b*BSIZE + BSIZE - sizeof(t);
+  if(writei(dp, 0, (uint64)&t, off, sizeof(t)) != sizeof(t))
+    panic("dirslot: writei");
+  return nb*BSIZE;
 }
 
 // Write a new directory entry (name, inum) into the directory dp.
@@ -558,6 +1048,7 @@ dirlink(struct inode *dp, char *name, uint inum)
 {
   int off;
   struct dirent de;
+  struct dirtail t;
   struct inode *ip;
 
   // Check that name is not present.
@@ -566,22 +1057,40 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
-  // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
+  if(dirtail(dp, 0, &t)){
+    off = dirslot(dp, name, t.nbucket);
+  } else {
+    // Look for an empty dirent.
+    for(off = 0; off < dp->size; off += sizeof(de)){
+      if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirlink read");
+      if(de.inum == 0)
+        break;
+    }
   }
 
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcacheadd(dp, name, inum, off);
 
   return 0;
 }
 
+// Remove the entry for name, which dirlookup() found at
+// offset off, from the directory dp.
+void
+dirunlink(struct inode *dp, char *name, uint off)
+{
+  struct dirent de;
+
+  memset(&de, 0, sizeof(de));
+  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    panic("unlink: writei");
+  dcacheadd(dp, name, 0, 0);
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -677,6 +1186,25 @@ nameiparent(char *path, char *name)
 #include "fcntl.h"
 #define DIGITS 14
 
+// Swap files are created the first time a process evicts a
+// page, not at fork(), since most processes never do. When a
+// process that has one exits, it's kept open here for the next
+// process that needs one, up to NSWAPFILE of them, instead of
+// being unlinked. A pooled file keeps the name it was created
+// with, which goes with it to each process that reuses it.
+struct {
+  struct spinlock lock;
+  struct file *file[NSWAPFILE];
+  char path[NSWAPFILE][DIGITS];
+  int n;
+} swappool;
+
+void
+swapinit(void)
+{
+  initlock(&swappool.lock, "swappool");
+}
+
 char* itoa(int i, char b[]){
     char const digit[] = "0123456789";
     char* p = b;
@@ -700,13 +1228,7 @@ char* itoa(int i, char b[]){
 int
 removeSwapFile(struct proc* p)
 {
-  //path of proccess
-  char path[DIGITS];
-  memmove(path,"/.swap", 6);
-  itoa(p->pid, path+ 6);
-
   struct inode *ip, *dp;
-  struct dirent de;
   char name[DIRSIZ];
   uint off;
 
@@ -714,10 +1236,22 @@ removeSwapFile(struct proc* p)
   {
     return -1;
   }
+
+  acquire(&swappool.lock);
+  if(swappool.n < NSWAPFILE){
+    safestrcpy(swappool.path[swappool.n], p->swapPath, DIGITS);
+    swappool.file[swappool.n++] = p->swapFile;
+    p->swapFile = 0;
+    release(&swappool.lock);
+    return 0;
+  }
+  release(&swappool.lock);
+
   fileclose(p->swapFile);
+  p->swapFile = 0;
 
   begin_op();
-  if((dp = nameiparent(path, name)) == 0)
+  if((dp = nameiparent(p->swapPath, name)) == 0)
   {
     end_op();
     return -1;
@@ -740,9 +1274,7 @@ removeSwapFile(struct proc* p)
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp,0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  dirunlink(dp, name, off);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -765,37 +1297,52 @@ removeSwapFile(struct proc* p)
 }
 
 
-//return 0 on success
+//return 0 on success, -1 if there's no free file or inode.
+//must not be called inside a transaction.
 int
 createSwapFile(struct proc* p)
 {
+  struct file *f;
+  struct inode *in;
+
+  acquire(&swappool.lock);
+  if(swappool.n > 0){
+    p->swapFile = swappool.file[--swappool.n];
+    safestrcpy(p->swapPath, swappool.path[swappool.n], DIGITS);
+    release(&swappool.lock);
+    return 0;
+  }
+  release(&swappool.lock);
 
-  char path[DIGITS];
-  memmove(path,"/.swap", 6);
-  itoa(p->pid, path+ 6);
+  memmove(p->swapPath, "/.swap", 6);
+  itoa(p->pid, p->swapPath + 6);
 
+  if((f = filealloc()) == 0)
+    return -1;
   begin_op();
-  
-  struct inode * in = create(path, T_FILE, 0, 0);
-  iunlock(in);
-  p->swapFile = filealloc();
-  if (p->swapFile == 0)
-    panic("no slot for files on /store");
-
-  p->swapFile->ip = in;
-  p->swapFile->type = FD_INODE;
-  p->swapFile->off = 0;
-  p->swapFile->readable = O_WRONLY;
-  p->swapFile->writable = O_RDWR;
+  if((in = create(p->swapPath, T_FILE, 0, 0)) == 0){
     end_op();
+    fileclose(f);
+    return -1;
+  }
+  iunlock(in);
+  end_op();
 
-    return 0;
+  f->ip = in;
+  f->type = FD_INODE;
+  f->off = 0;
+  f->readable = O_WRONLY;
+  f->writable = O_RDWR;
+  p->swapFile = f;
+  return 0;
 }
 
 //return as sys_write (-1 when error)
 int
 writeToSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size)
 {
+  if(p->swapFile == 0 && createSwapFile(p) < 0)
+    return -1;
   p->swapFile->off = placeOnFile;
   return kfilewrite(p->swapFile, (uint64)buffer, size);
 }
@@ -24,9 +24,10 @@ struct superblock {
 
 #define FSMAGIC 0x10203040
 
-#define NDIRECT 12
+#define NDIRECT 11
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT)
 
 // On-disk inode structure
 struct dinode {
@@ -35,7 +36,7 @@ struct dinode {
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NDIRECT+2];   // Data block addresses
 };
 
 // Inodes per block.
@@ -58,3 +59,23 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// Directory entries per block
+#define DPB           (BSIZE / sizeof(struct dirent))
+
+// A hashed directory's first NDIRBUCKET blocks are the heads
+// of bucket chains; see dirlookup(). The last slot of each of
+// its blocks holds a dirtail instead of an entry. Its inum is
+// 0, so readers that treat the directory as an array of
+// dirents skip it.
+#define NDIRBUCKET 16
+#define DIRMAGIC0  0xff
+#define DIRMAGIC1  'H'
+
+struct dirtail {
+  ushort inum;      // always 0
+  uchar magic[2];   // DIRMAGIC0, DIRMAGIC1
+  uint nbucket;     // number of bucket chains
+  uint next;        // next block of this chain, or 0
+  uint pad;
+};
+
@@ -8,6 +8,7 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "defs.h"
+#include "memstat.h"
 
 void freerange(void *pa_start, void *pa_end);
 
@@ -18,9 +19,14 @@ struct run {
   struct run *next;
 };
 
+#define NPHYSPG ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PGINDEX(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
 struct {
   struct spinlock lock;
   struct run *freelist;
+  uchar type[NPHYSPG];  // KMEM_* use of each physical page
+  struct memstat stat;
 } kmem;
 
 void
@@ -28,6 +34,8 @@ kinit()
 {
   initlock(&kmem.lock, "kmem");
   freerange(end, (void*)PHYSTOP);
+  kmem.stat.total = kmem.stat.free;
+  kmem.stat.minfree = kmem.stat.free;
 }
 
 void
@@ -59,24 +67,73 @@ kfree(void *pa)
   acquire(&kmem.lock);
   r->next = kmem.freelist;
   kmem.freelist = r;
+  if(kmem.type[PGINDEX(pa)] != KMEM_FREE)
+    kmem.stat.used[kmem.type[PGINDEX(pa)]]--;
+  kmem.type[PGINDEX(pa)] = KMEM_FREE;
+  kmem.stat.free++;
   release(&kmem.lock);
 }
 
-// Allocate one 4096-byte page of physical memory.
+// Allocate one 4096-byte page of physical memory,
+// charging it to type (one of KMEM_* in memstat.h).
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
 void *
-kalloc(void)
+kalloctype(int type)
 {
   struct run *r;
 
+  if(type <= KMEM_FREE || type >= KMEM_NTYPE)
+    panic("kalloctype");
+
   acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.type[PGINDEX(r)] = type;
+    kmem.stat.used[type]++;
+    kmem.stat.nalloc++;
+    if(--kmem.stat.free < kmem.stat.minfree)
+      kmem.stat.minfree = kmem.stat.free;
+  } else {
+    kmem.stat.nfail++;
+  }
   release(&kmem.lock);
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
   return (void*)r;
 }
+
+void *
+kalloc(void)
+{
+  return kalloctype(KMEM_OTHER);
+}
+
+// Charge the allocated page pa to type instead, when it's
+// handed from one use to another without being freed.
+void
+kmemretype(void *pa, int type)
+{
+  if(type <= KMEM_FREE || type >= KMEM_NTYPE)
+    panic("kmemretype");
+
+  acquire(&kmem.lock);
+  if(kmem.type[PGINDEX(pa)] == KMEM_FREE)
+    panic("kmemretype: free");
+  kmem.stat.used[kmem.type[PGINDEX(pa)]]--;
+  kmem.type[PGINDEX(pa)] = type;
+  kmem.stat.used[type]++;
+  release(&kmem.lock);
+}
+
+// Copy out a snapshot of the allocator's counters.
+void
+kmemstat(struct memstat *st)
+{
+  acquire(&kmem.lock);
+  *st = kmem.stat;
+  release(&kmem.lock);
+  st->peak = st->total - st->minfree;
+}
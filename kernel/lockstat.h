@@ -0,0 +1,16 @@
+// Spinlock contention statistics, filled in by the lockstat()
+// system call. Locks are counted by name, so e.g. all the "proc"
+// locks share one entry.
+// Both the kernel and user programs use this header file.
+
+#define LOCKNAME 16
+
+struct lockstat {
+  char name[LOCKNAME];
+  uint64 nlock;       // locks initialized with this name
+  uint64 nacquire;    // calls to acquire()
+  uint64 ncontend;    // acquires that found the lock held
+  uint64 nspin;       // total spin-loop iterations waiting
+  uint64 holdtime;    // total cycles held
+  uint64 maxhold;     // longest single hold, in cycles
+};
@@ -3,23 +3,33 @@
 #include "defs.h"
 #include "param.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "logstat.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
 // A log transaction contains the updates of multiple FS system
-// calls. The logging system only commits when there are
-// no FS system calls active. Thus there is never
+// calls. A transaction is only closed when there are
+// no FS system calls active in it. Thus there is never
 // any reasoning required about whether a commit might
 // write an uncommitted system call's updates to disk.
 //
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// But if it thinks the log is close to running out, or the
+// committer is closing the transaction, it sleeps.
+//
+// Commits are done by a kernel process, the committer, not
+// by end_op(). Transactions are double-buffered: once the
+// committer has closed a transaction and copied its blocks
+// into log buffers, new FS system calls join the next
+// transaction while the closed one is written to disk. So
+// system calls return before their updates are durable;
+// fsync() waits for that.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -28,7 +38,17 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// A 0 in the header marks a free slot.
+//
+// Committed blocks are not copied to their home locations
+// right away. They stay in the log, with their cache copies
+// pinned, and a commit just writes its blocks to free slots
+// and then a header listing the old and new slots together.
+// A block committed again frees its older slot. Only when
+// the log runs out of free slots does checkpoint() install
+// everything, so a block rewritten by many transactions,
+// like a bitmap block, goes to its home location once.
+// The blocks of a commit are written concurrently.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -42,14 +62,39 @@ struct log {
   int start;
   int size;
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int reserved;    // log blocks they have reserved.
+  int closing;     // committer is waiting to close lh; please wait.
+  int nflush;      // processes waiting in log_flush()
+  int seq;         // number of the open transaction
+  int done;        // transactions before this one are on disk
   int dev;
-  struct logheader lh;
+  struct logheader lh;  // the open transaction
+
+  // the rest is only used by the committer.
+
+  // the closed transaction it is writing.
+  struct logheader clh;
+  int slot[LOGSIZE];          // log slot for each block
+  struct buf *to[LOGSIZE];    // log buffers holding its blocks
+  struct buf *from[LOGSIZE];  // its (pinned) cache buffers
+  struct buf *stale[LOGSIZE]; // pins it replaces
+
+  // committed blocks not yet installed: the on-disk header,
+  // and the pinned cache buffer of the block in each slot.
+  int nslot;
+  struct logheader disk;
+  struct buf *pinned[LOGSIZE];
+
+  // not in the cache: alias log buffers' data, but with
+  // blockno set to the home location, for installing.
+  struct buf home[LOGSIZE];
+  struct buf *hbuf[LOGSIZE];  // sorted pointers to home[]
+  struct buf *lbuf[LOGSIZE];  // the log buffers they alias
 };
 struct log log;
 
 static void recover_from_log(void);
-static void commit();
+static void committer(void);
 
 void
 initlog(int dev, struct superblock *sb)
@@ -61,24 +106,55 @@ initlog(int dev, struct superblock *sb)
   log.start = sb->logstart;
   log.size = sb->nlog;
   log.dev = dev;
+  log.nslot = log.size - 1 < LOGSIZE ? log.size - 1 : LOGSIZE;
+  if (log.nslot < MAXOPBLOCKS)
+    panic("initlog: log too small");
+  for (int i = 0; i < LOGSIZE; i++)
+    initsleeplock(&log.home[i].lock, "loghome");
   recover_from_log();
+  kproc("committer", committer);
+}
+
+// Sort bufs by block number.
+static void
+sortbufs(struct buf **b, int n)
+{
+  int i, j;
+  struct buf *t;
+
+  for(i = 1; i < n; i++){
+    t = b[i];
+    for(j = i; j > 0 && b[j-1]->blockno > t->blockno; j--)
+      b[j] = b[j-1];
+    b[j] = t;
+  }
 }
 
-// Copy committed blocks from log to their home location
+// Copy committed blocks from log to their home location.
+// Only used at boot; all the writes are started before
+// waiting for any.
 static void
-install_trans(int recovering)
+install_trans(void)
 {
   int tail;
+  struct buf **dbuf = log.hbuf;
+
+  int n = 0;
 
   for (tail = 0; tail < log.lh.n; tail++) {
+    if(log.lh.block[tail] == 0)
+      continue;  // free slot
     struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
+    dbuf[n] = bnoread(log.dev, log.lh.block[tail]);
+    memmove(dbuf[n]->data, lbuf->data, BSIZE);  // copy block to dst
     brelse(lbuf);
-    brelse(dbuf);
+    n++;
+  }
+  sortbufs(dbuf, n);  // so adjacent blocks share a request
+  bwritestart(dbuf, n);  // write dst to disk
+  for (tail = 0; tail < n; tail++) {
+    bwait(dbuf[tail]);
+    brelse(dbuf[tail]);
   }
 }
 
@@ -96,18 +172,18 @@ read_head(void)
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Write log header lh to disk.
+// This is the true point at which a
+// transaction commits.
 static void
-write_head(void)
+write_head(struct logheader *lh)
 {
-  struct buf *buf = bread(log.dev, log.start);
+  struct buf *buf = bnoread(log.dev, log.start);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = lh->n;
+  for (i = 0; i < lh->n; i++) {
+    hb->block[i] = lh->block[i];
   }
   bwrite(buf);
   brelse(buf);
@@ -117,94 +193,265 @@ static void
 recover_from_log(void)
 {
   read_head();
-  install_trans(1); // if committed, copy from log to disk
+  install_trans(); // if committed, copy from log to disk
   log.lh.n = 0;
-  write_head(); // clear the log
+  write_head(&log.lh); // clear the log
 }
 
 // called at the start of each FS system call.
 void
 begin_op(void)
 {
+  begin_opn(MAXOPBLOCKS);
+}
+
+// called at the start of an FS system call that may
+// write up to n blocks; n must be at most logmaxop().
+// Ops must not nest: an op waiting for the committer while
+// its process holds another op open would never wake up.
+// So nothing that may write to the file system, such as
+// evicting a page to the swap file, may run inside an op.
+void
+begin_opn(int n)
+{
+  struct proc *p = myproc();
+
+  if(n < 1 || n > logmaxop())
+    panic("begin_opn");
+  if(p->logres != 0)
+    panic("begin_op: nested");
   acquire(&log.lock);
   while(1){
-    if(log.committing){
+    if(log.closing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log.lh.n + log.reserved + n > log.nslot){
       // this op might exhaust log space; wait for commit.
+      wakeup(&log.lh);
       sleep(&log, &log.lock);
     } else {
-      log.outstanding += 1;
-      release(&log.lock);
       break;
     }
   }
+  log.outstanding += 1;
+  log.reserved += n;
+  p->logres = n;
+  release(&log.lock);
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// lets the committer know if this was the last
+// outstanding operation.
 void
 end_op(void)
 {
-  int do_commit = 0;
+  struct proc *p = myproc();
 
+  if(p->logres == 0)
+    panic("end_op");
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
-  } else {
-    // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
-  }
+  log.reserved -= p->logres;
+  p->logres = 0;
+  if(log.outstanding == 0)
+    wakeup(&log.lh);
+  // begin_op() may be waiting for log space,
+  // and ending this op has decreased
+  // the amount of reserved space.
+  wakeup(&log);
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+// the most blocks one FS system call may reserve: half
+// the log, so that a big op can share it with smaller ones.
+int
+logmaxop(void)
+{
+  return log.nslot / 2 > MAXOPBLOCKS ? log.nslot / 2 : MAXOPBLOCKS;
+}
+
+// Wait until everything done by FS system calls
+// that have already returned is on disk.
+void
+log_flush(void)
+{
+  int target;
+
+  acquire(&log.lock);
+  target = log.lh.n > 0 ? log.seq + 1 : log.seq;
+  log.nflush++;
+  wakeup(&log.lh);
+  while(log.done < target)
+    sleep(&log.done, &log.lock);
+  log.nflush--;
+  release(&log.lock);
+}
+
+// Fill in st with a consistent snapshot of the log's progress.
+void
+logstat(struct logstat *st)
+{
+  acquire(&log.lock);
+  st->seq = log.seq;
+  st->done = log.done;
+  st->nblock = log.lh.n;
+  st->outstanding = log.outstanding;
+  st->reserved = log.reserved;
+  st->nslot = log.nslot;
+  release(&log.lock);
+}
+
+// Install every committed block from its log slot to its
+// home location, then free all the slots. The cache copies
+// may already hold updates from later transactions, so the
+// data comes from the log buffers.
+static void
+checkpoint(void)
+{
+  struct buf **home = log.hbuf, **lbuf = log.lbuf;
+  int i, n = 0;
+
+  for (i = 0; i < log.disk.n; i++) {
+    if(log.disk.block[i] == 0)
+      continue;
+    lbuf[n] = bread(log.dev, log.start+i+1);
+    home[n] = &log.home[n];
+    acquiresleep(&home[n]->lock);
+    home[n]->dev = log.dev;
+    home[n]->blockno = log.disk.block[i];
+    home[n]->data = lbuf[n]->data;
+    n++;
+  }
+  sortbufs(home, n);  // so adjacent blocks share a request
+  bwritestart(home, n);
+  for (i = 0; i < n; i++) {
+    bwait(home[i]);
+    releasesleep(&home[i]->lock);
+    brelse(lbuf[i]);
+  }
+
+  // the home locations are current, so the log can be cleared
+  // and the cache copies let go.
+  for (i = 0; i < log.disk.n; i++) {
+    if(log.disk.block[i] != 0)
+      bunpin(log.pinned[i]);
+    log.disk.block[i] = 0;
   }
+  log.disk.n = 0;
+  write_head(&log.disk);
+}
+
+// Choose a free log slot for each of the closed transaction's
+// blocks, checkpointing first if there aren't enough.
+static void
+allocslots(void)
+{
+  int i, nfree = 0, tail = 0;
+
+  for (i = 0; i < log.nslot; i++)
+    if(log.disk.block[i] == 0)
+      nfree++;
+  if(nfree < log.clh.n)
+    checkpoint();
+  for (i = 0; tail < log.clh.n; i++)
+    if(log.disk.block[i] == 0)
+      log.slot[tail++] = i;
 }
 
-// Copy modified blocks from cache to log.
+// Copy the closed transaction's modified blocks from cache
+// to log buffers. No FS system calls are running, so the
+// copies are consistent; after this, they may change the
+// cache copies again.
 static void
-write_log(void)
+snapshot(void)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  for (tail = 0; tail < log.clh.n; tail++) {
+    log.to[tail] = bnoread(log.dev, log.start+log.slot[tail]+1); // log block
+    log.from[tail] = bread(log.dev, log.clh.block[tail]); // cache block
+    memmove(log.to[tail]->data, log.from[tail]->data, BSIZE);
+    brelse(log.from[tail]);  // still pinned
   }
 }
 
+// Write the closed transaction to its log slots, then a header
+// that adds them to the log and frees any older slots holding
+// the same blocks. The blocks stay pinned in the cache until
+// checkpoint() installs them.
 static void
-commit()
+commit(void)
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
+  struct buf **stale = log.stale;
+  int n = log.clh.n;
+  int i, tail, nstale = 0;
+
+  bwritestart(log.to, n);  // write the log
+  for (tail = 0; tail < n; tail++) {
+    bwait(log.to[tail]);
+    brelse(log.to[tail]);
+  }
+
+  for (tail = 0; tail < n; tail++) {
+    for (i = 0; i < log.disk.n; i++) {
+      if(log.disk.block[i] == log.clh.block[tail]){
+        // committed again: this transaction's pin replaces
+        // the older slot's.
+        stale[nstale++] = log.pinned[i];
+        log.disk.block[i] = 0;
+      }
+    }
+    log.disk.block[log.slot[tail]] = log.clh.block[tail];
+    log.pinned[log.slot[tail]] = log.from[tail];
+    if(log.slot[tail] >= log.disk.n)
+      log.disk.n = log.slot[tail] + 1;
+  }
+  write_head(&log.disk);   // Write header to disk -- the real commit
+
+  for (i = 0; i < nstale; i++)
+    bunpin(stale[i]);
+}
+
+// The committer closes the open transaction once no system
+// calls are active in it, or sooner if it is running out of
+// log space or someone is waiting in log_flush(). Closing
+// blocks new system calls only until snapshot() is done.
+static void
+committer(void)
+{
+  acquire(&log.lock);
+  for(;;){
+    while(log.lh.n == 0 ||
+          (log.outstanding > 0 && log.nflush == 0 &&
+           log.lh.n + log.reserved + MAXOPBLOCKS <= log.nslot))
+      sleep(&log.lh, &log.lock);
+
+    log.closing = 1;
+    while(log.outstanding > 0)
+      sleep(&log.lh, &log.lock);
+    log.clh = log.lh;
+    release(&log.lock);
+
+    allocslots();
+    snapshot();
+
+    acquire(&log.lock);
     log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    log.seq++;
+    log.closing = 0;
+    wakeup(&log);
+    release(&log.lock);
+
+    commit();
+
+    acquire(&log.lock);
+    log.done = log.seq;
+    wakeup(&log.done);
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// The committer will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -217,7 +464,7 @@ log_write(struct buf *b)
   int i;
 
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.nslot)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -0,0 +1,11 @@
+// File system log progress, filled in by the logstat() system call.
+// Both the kernel and user programs use this header file.
+
+struct logstat {
+  int seq;          // number of the open transaction
+  int done;         // transactions before this one are on disk
+  int nblock;       // blocks logged in the open transaction
+  int outstanding;  // FS system calls in progress
+  int reserved;     // log blocks they have reserved
+  int nslot;        // log blocks a transaction may use
+};
@@ -26,6 +26,9 @@ main()
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode cache
+    dcacheinit();    // directory entry cache
+    pcacheinit();    // page cache
+    swapinit();      // pool of swap files
     fileinit();      // file table
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
@@ -0,0 +1,28 @@
+// Physical memory accounting, filled in by the memstat() system call.
+// Both the kernel and user programs use this header file.
+
+// what a kalloc()ed page is being used for.
+#define KMEM_FREE       0   // on the free list
+#define KMEM_OTHER      1   // untagged kalloc() callers
+#define KMEM_USER       2   // user memory
+#define KMEM_PGTBL      3   // page-table pages
+#define KMEM_KSTACK     4   // kernel stacks
+#define KMEM_TRAPFRAME  5   // per-process trapframes
+#define KMEM_PIPE       6   // pipe buffers
+#define KMEM_BUF        7   // buffer cache
+#define KMEM_INODE      8   // i-node cache
+#define KMEM_PCACHE     9   // page cache, for mmap()
+#define KMEM_NTYPE      10
+
+struct memstat {
+  uint64 total;             // pages managed by kalloc
+  uint64 free;              // pages on the free list
+  uint64 minfree;           // fewest free pages ever seen
+  uint64 peak;              // most pages ever in use (total - minfree)
+  uint64 used[KMEM_NTYPE];  // pages in use, by type (used[KMEM_FREE] unused)
+  uint64 nalloc;            // successful kalloc() calls
+  uint64 nfail;             // kalloc() calls that found no free page
+  uint64 nbuf;              // buffer cache size, in buffers
+  uint64 bufinuse;          // buffers referenced by someone
+  uint64 bufpinned;         // buffers pinned by the log
+};
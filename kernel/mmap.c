@@ -0,0 +1,356 @@
+// Memory-mapped files.
+//
+// mmap() only records a region in a free slot of p->vma[];
+// pages are mapped when they're first touched, by
+// mmapfault(). Pages come from the page cache (pcache.c), so
+// all mappings of a file share them. A MAP_PRIVATE region maps
+// cache pages read-only and copies a page the first time it's
+// written. A MAP_SHARED region maps cache pages read-only too,
+// and makes a page writable on its first store, so PTE_W marks
+// the pages that need to be written back to the file when
+// they're unmapped. PTEs that map cache pages carry PTE_CACHE,
+// which tells them apart from private copies, and tells the
+// uvm functions to leave them to this file.
+//
+// Regions are placed below MMAPTOP, each beneath the lowest
+// one so far, far above anything sbrk() can reach. exec() maps
+// a program's read-only text the same way, as a private region
+// at its link address, so every process running a program
+// shares one copy of its text.
+//
+// copyout() won't write a page that isn't writable. copyin()
+// and copyout() fault in pages only when no spin lock and no
+// inode lock is held. read() and write() fault in the pages of
+// their buffers first with mmapprefault(); a page it couldn't
+// map makes the copy fail rather than fault with an inode
+// locked.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+#include "memstat.h"
+
+static struct vma *
+findvma(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->ip && va >= v->addr && va < v->addr + v->len)
+      return v;
+  return 0;
+}
+
+// page number in the file of user page va of v.
+static uint
+vpgno(struct vma *v, uint64 va)
+{
+  return (va - v->addr + v->off) / PGSIZE;
+}
+
+// Map len bytes of f, starting at file offset off, into the
+// current process. Return the address, or -1.
+uint64
+mmap(uint64 len, int prot, int flags, struct file *f, uint off)
+{
+  struct proc *p = myproc();
+  struct vma *v, *free = 0;
+  uint64 addr = MMAPTOP;
+
+  // check len before rounding it up, which could wrap to 0.
+  if(f->type != FD_INODE || len == 0 || len > MMAPTOP - MMAPBASE ||
+     off % PGSIZE != 0)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  if(!f->readable)  // pages are always readable
+    return -1;
+  if((prot & PROT_WRITE) && flags == MAP_SHARED && !f->writable)
+    return -1;
+
+  len = PGROUNDUP(len);
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->ip == 0){
+      if(free == 0)
+        free = v;
+    } else if(v->addr >= MMAPBASE && v->addr < addr){
+      addr = v->addr;
+    }
+  }
+  if(free == 0 || len > addr - MMAPBASE)
+    return -1;
+
+  v = free;
+  v->addr = addr - len;
+  v->len = len;
+  v->prot = prot;
+  v->flags = flags;
+  v->ip = idup(f->ip);
+  v->off = off;
+  return v->addr;
+}
+
+// Map the len bytes of text at file offset off of ip at va, in
+// p, which exec() has just emptied of regions. Takes over the
+// caller's reference to ip.
+void
+mmaptext(struct proc *p, struct inode *ip, uint64 va, uint64 len, uint off)
+{
+  struct vma *v = p->vma;
+
+  v->addr = va;
+  v->len = PGROUNDUP(len);
+  v->prot = PROT_READ | PROT_EXEC;
+  v->flags = MAP_PRIVATE;
+  v->ip = ip;
+  v->off = off;
+}
+
+// Copy the page at pa for a private mapping.
+static uint64
+pcopy(uint64 pa)
+{
+  char *mem;
+
+  if((mem = kalloctype(KMEM_USER)) == 0)
+    return 0;
+  memmove(mem, (char*)pa, PGSIZE);
+  return (uint64)mem;
+}
+
+// Handle a fault at va needing access need (PTE_R, PTE_W or
+// PTE_X). Return 0 if va is in a mapped region that allows
+// the access and the page is now mapped, else -1.
+int
+mmapfault(struct proc *p, uint64 va, int need)
+{
+  struct vma *v;
+  struct inode *ip;
+  pte_t *pte;
+  uint64 pa, mem;
+  uint pgno;
+  int perm;
+
+  if((v = findvma(p, va)) == 0)
+    return -1;
+  if((need == PTE_R && (v->prot & PROT_READ) == 0) ||
+     (need == PTE_W && (v->prot & PROT_WRITE) == 0) ||
+     (need == PTE_X && (v->prot & PROT_EXEC) == 0))
+    return -1;
+  va = PGROUNDDOWN(va);
+  pgno = vpgno(v, va);
+  ip = v->ip;
+
+  pte = walk(p->pagetable, va, 0);
+  if(pte && (*pte & PTE_V)){
+    // only a store to a page mapped read-only can be fixed.
+    if(need != PTE_W || (*pte & PTE_W))
+      return -1;
+    pa = PTE2PA(*pte);
+    perm = PTE_FLAGS(*pte) | PTE_W;
+    if(v->flags == MAP_PRIVATE){
+      if((mem = pcopy(pa)) == 0)
+        return -1;
+      pcacheput(pa);
+      pa = mem;
+      perm &= ~PTE_CACHE;
+    }
+    *pte = PA2PTE(pa) | perm;
+    sfence_vma();
+    return 0;
+  }
+
+  ilock(ip);
+  pa = pcacheget(ip, pgno);
+  iunlock(ip);
+  if(pa == 0)
+    return -1;
+
+  perm = PTE_U | PTE_R | PTE_CACHE;
+  if(v->prot & PROT_EXEC)
+    perm |= PTE_X;
+  if(need == PTE_W){
+    perm |= PTE_W;
+    if(v->flags == MAP_PRIVATE){
+      mem = pcopy(pa);
+      pcacheput(pa);
+      if((pa = mem) == 0)
+        return -1;
+      perm &= ~PTE_CACHE;
+    }
+  }
+  if(mappages(p->pagetable, va, PGSIZE, pa, perm) != 0){
+    if(perm & PTE_CACHE)
+      pcacheput(pa);
+    else
+      kfree((void*)pa);
+    return -1;
+  }
+  return 0;
+}
+
+// Fault in the mapped-file pages among the n bytes at addr,
+// for a system call about to copy to (PTE_W) or from (PTE_R)
+// them. Other pages are left for copyin() or copyout() to
+// reject or accept.
+void
+mmapprefault(uint64 addr, uint64 n, int need)
+{
+  struct proc *p = myproc();
+  uint64 va;
+  pte_t *pte;
+
+  if(n == 0 || addr + n < addr)
+    return;
+  for(va = PGROUNDDOWN(addr); va < addr + n; va += PGSIZE){
+    if(va >= MAXVA || findvma(p, va) == 0)
+      continue;
+    pte = walk(p->pagetable, va, 0);
+    if(pte == 0 || (*pte & PTE_V) == 0 ||
+       (need == PTE_W && (*pte & PTE_W) == 0))
+      mmapfault(p, va, need);
+  }
+}
+
+// Write page pgno of ip, at pa, back to the file.
+static void
+writeback(struct inode *ip, uint pgno, uint64 pa)
+{
+  uint off = pgno * PGSIZE, n;
+
+  // the blocks are already allocated, so the write
+  // changes only them and the inode.
+  begin_opn(PGSIZE/BSIZE + 1);
+  ilock(ip);
+  if(off < ip->size){
+    n = ip->size - off < PGSIZE ? ip->size - off : PGSIZE;
+    writei(ip, 0, pa, off, n);
+  }
+  iunlock(ip);
+  end_op();
+}
+
+// Unmap the pages of v in [va, va+len) from p's page table,
+// writing back the ones a MAP_SHARED mapping has stored to.
+static void
+unmapvma(struct proc *p, struct vma *v, uint64 va, uint64 len)
+{
+  uint64 a, pa;
+  pte_t *pte;
+
+  for(a = va; a < va + len; a += PGSIZE){
+    if((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;
+    pa = PTE2PA(*pte);
+    if((*pte & PTE_CACHE) == 0){
+      kfree((void*)pa);
+    } else {
+      if(v->flags == MAP_SHARED && (*pte & PTE_W))
+        writeback(v->ip, vpgno(v, a), pa);
+      pcacheput(pa);
+    }
+    // program text stays reserved for uvmunmap().
+    *pte = a < p->sz ? PTE_CACHE : 0;
+  }
+  sfence_vma();
+}
+
+// Release v's slot and its reference to the inode.
+static void
+vmafree(struct vma *v)
+{
+  begin_op();
+  iput(v->ip);
+  end_op();
+  v->addr = 0;
+  v->ip = 0;
+}
+
+// Unmap [addr, addr+len), which must be the start or the end
+// (or all) of one mapped region.
+int
+munmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+
+  if(addr % PGSIZE != 0 || len == 0 || len > MMAPTOP - MMAPBASE)
+    return -1;
+  len = PGROUNDUP(len);
+  if((v = findvma(p, addr)) == 0 || addr + len > v->addr + v->len)
+    return -1;
+  if(addr != v->addr && addr + len != v->addr + v->len)
+    return -1;
+
+  unmapvma(p, v, addr, len);
+  if(addr == v->addr){
+    v->addr += len;
+    v->off += len;
+  }
+  v->len -= len;
+  if(v->len == 0)
+    vmafree(v);
+  return 0;
+}
+
+// Unmap all of p's regions, at exit() or exec().
+void
+munmapall(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->ip == 0)
+      continue;
+    unmapvma(p, v, v->addr, v->len);
+    vmafree(v);
+  }
+}
+
+// Give the child np of fork() p's regions. A private page
+// that p has copied is copied again; other pages are shared.
+// A shared page starts out clean in the child.
+int
+mmapcopy(struct proc *np, struct proc *p)
+{
+  struct vma *v, *nv;
+  uint64 a, pa;
+  pte_t *pte;
+  int perm;
+
+  for(v = p->vma, nv = np->vma; v < &p->vma[NVMA]; v++, nv++){
+    if(v->ip == 0)
+      continue;
+    *nv = *v;
+    idup(nv->ip);
+    for(a = v->addr; a < v->addr + v->len; a += PGSIZE){
+      if((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+        continue;
+      pa = PTE2PA(*pte);
+      perm = PTE_FLAGS(*pte);
+      if((perm & PTE_CACHE) == 0){
+        if((pa = pcopy(pa)) == 0)
+          return -1;
+      } else {
+        perm &= ~PTE_W;
+        pcachedup(pa);
+      }
+      if(mappages(np->pagetable, a, PGSIZE, pa, perm) != 0){
+        if(perm & PTE_CACHE)
+          pcacheput(pa);
+        else
+          kfree((void*)pa);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
@@ -2,12 +2,33 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NSWAPFILE   8    // unused swap files kept for reuse
+#define NINODE       50  // min size of i-node cache
+#define NDENTRY     128  // size of directory entry cache
+#define NVMA         16  // mmap()ed regions per process
+#define NPCACHE     512  // size of page cache
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define NSPAWNFD     3   // file descriptors spawn() can set up
+#define PIPEMAXPG    64  // max pages in a pipe's buffer
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+// A log header block could list BSIZE/4-1 blocks. LOGSIZE is about
+// half that, because the block cache must hold 3*LOGSIZE blocks
+// (see NBUF), and struct log has several arrays of LOGSIZE entries.
+#define LOGSIZE      126   // max data blocks in on-disk log; mkfs picks its size
+#define NBUF         (LOGSIZE*3+MAXOPBLOCKS) // min size of disk block cache
+#ifndef BUFPCT
+#define BUFPCT        5    // % of free memory for block cache; make BUFPCT=n
+#endif
+#ifndef INODEPCT
+#define INODEPCT      1    // % of free memory for i-node cache; make INODEPCT=n
+#endif
+#define NREADAHEAD    8    // blocks readi() reads ahead of a sequential reader
+#define FSSIZE       10000 // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define TIMERFREQ 10000000 // CLINT timer cycles per second (qemu)
+#ifndef HZ
+#define HZ           10    // timer interrupts per second; make HZ=n
+#endif
+#define TICKCYCLES   (TIMERFREQ/HZ)  // timer cycles per tick
@@ -0,0 +1,287 @@
+// Page cache.
+//
+// Holds whole pages of file contents for mmap(). Every mapping
+// of a page of a file maps the same physical page, so mapping
+// a file costs no copy once its pages are cached, and
+// MAP_SHARED mappings see each other's stores.
+//
+// A page is named by (dev, inum, pgno) and is filled from the
+// file by readi() the first time it's wanted. ref counts the
+// page tables that map it; they mark those PTEs with PTE_CACHE
+// and hand the page back to pcacheput() by its address. Pages
+// no one maps stay cached on an LRU list until their entry is
+// needed for another page.
+//
+// Callers of pcacheget() hold the inode's sleep-lock, and
+// writei() calls pcachewrite() to copy what it writes into
+// any cached page, so a cached page always has the file's
+// contents, except for stores through MAP_SHARED mappings
+// that haven't been written back yet; see munmap().
+// Truncating a file drops its pages; ones still mapped become
+// stale, and are freed when they're unmapped.
+//
+// pcache.lock protects the table, the hash chains, the LRU
+// list, and each entry's fields.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+#include "memstat.h"
+
+#define NPCHASH 61
+
+struct cpage {
+  uint dev;
+  uint inum;
+  uint pgno;            // page number in the file
+  int stale;            // the file was truncated
+  uint64 pa;            // the page, or 0
+  int ref;              // page tables mapping the page
+  struct cpage *next;   // hash chain
+  struct cpage *pnext;  // chain in pahash, by pa
+  struct cpage *lprev;  // LRU list of unmapped pages; newest first
+  struct cpage *lnext;
+};
+
+struct {
+  struct spinlock lock;
+  struct cpage page[NPCACHE];
+  struct cpage *hash[NPCHASH];
+  struct cpage *pahash[NPCHASH];
+  struct cpage lru;
+} pcache;
+
+static struct cpage **
+phash(uint dev, uint inum, uint pgno)
+{
+  return &pcache.hash[((dev * 31 + inum) * 31 + pgno) % NPCHASH];
+}
+
+static struct cpage **
+pahash(uint64 pa)
+{
+  return &pcache.pahash[(pa / PGSIZE) % NPCHASH];
+}
+
+static void
+lruremove(struct cpage *cp)
+{
+  cp->lprev->lnext = cp->lnext;
+  cp->lnext->lprev = cp->lprev;
+}
+
+// Put cp on the LRU list: at the newest end if it holds a
+// page worth keeping, else at the end that's reused first.
+static void
+lruinsert(struct cpage *cp, int keep)
+{
+  struct cpage *at = keep ? &pcache.lru : pcache.lru.lprev;
+
+  cp->lnext = at->lnext;
+  cp->lprev = at;
+  at->lnext->lprev = cp;
+  at->lnext = cp;
+}
+
+// Remove cp from its hash chain, if it's on one.
+static void
+punhash(struct cpage *cp)
+{
+  struct cpage **pp;
+
+  for(pp = phash(cp->dev, cp->inum, cp->pgno); *pp; pp = &(*pp)->next){
+    if(*pp == cp){
+      *pp = cp->next;
+      return;
+    }
+  }
+}
+
+// Find the current entry for page pgno of ip.
+static struct cpage *
+pfind(struct inode *ip, uint pgno)
+{
+  struct cpage *cp;
+
+  for(cp = *phash(ip->dev, ip->inum, pgno); cp; cp = cp->next)
+    if(cp->dev == ip->dev && cp->inum == ip->inum && cp->pgno == pgno &&
+       !cp->stale)
+      return cp;
+  return 0;
+}
+
+// Find the entry holding page pa, stale or not.
+static struct cpage *
+pfindpa(uint64 pa)
+{
+  struct cpage *cp;
+
+  for(cp = *pahash(pa); cp; cp = cp->pnext)
+    if(cp->pa == pa)
+      return cp;
+  return 0;
+}
+
+// Drop cp's entry, which no one maps, freeing its page.
+static void
+pdrop(struct cpage *cp)
+{
+  struct cpage **pp;
+
+  punhash(cp);
+  for(pp = pahash(cp->pa); *pp != cp; pp = &(*pp)->pnext)
+    ;
+  *pp = cp->pnext;
+  kfree((void*)cp->pa);
+  cp->pa = 0;
+  cp->stale = 0;
+}
+
+void
+pcacheinit(void)
+{
+  struct cpage *cp;
+
+  initlock(&pcache.lock, "pcache");
+  pcache.lru.lnext = &pcache.lru;
+  pcache.lru.lprev = &pcache.lru;
+  for(cp = pcache.page; cp < &pcache.page[NPCACHE]; cp++)
+    lruinsert(cp, 0);
+}
+
+// Return page pgno of ip, reading it if it isn't cached, and
+// count a reference to it. Bytes past the end of the file
+// read as zeros. Caller must hold ip's lock.
+// Returns 0 if there's no free entry or memory.
+uint64
+pcacheget(struct inode *ip, uint pgno)
+{
+  struct cpage *cp;
+  struct cpage **head = phash(ip->dev, ip->inum, pgno);
+  uint64 pa;
+  uint off = pgno * PGSIZE;
+
+  acquire(&pcache.lock);
+  if((cp = pfind(ip, pgno)) != 0){
+    if(cp->ref++ == 0)
+      lruremove(cp);
+    release(&pcache.lock);
+    return cp->pa;
+  }
+
+  // Recycle the least recently used entry, and its page.
+  cp = pcache.lru.lprev;
+  if(cp == &pcache.lru){
+    release(&pcache.lock);
+    return 0;
+  }
+  lruremove(cp);
+  punhash(cp);
+  pa = cp->pa;  // stays on pahash while we fill it
+  cp->dev = ip->dev;
+  cp->inum = ip->inum;
+  cp->pgno = pgno;
+  cp->stale = 0;
+  cp->ref = 1;
+  release(&pcache.lock);
+
+  // No one else can look for this page while we hold ip's
+  // lock, so it's safe to fill it before it's hashed.
+  if(pa == 0){
+    if((pa = (uint64)kalloctype(KMEM_PCACHE)) == 0)
+      goto bad;
+    acquire(&pcache.lock);
+    cp->pa = pa;
+    cp->pnext = *pahash(pa);
+    *pahash(pa) = cp;
+    release(&pcache.lock);
+  }
+  memset((void*)pa, 0, PGSIZE);
+  if(off < ip->size){
+    uint n = ip->size - off < PGSIZE ? ip->size - off : PGSIZE;
+    if(readi(ip, 0, pa, off, n) != n)
+      goto bad;
+  }
+
+  acquire(&pcache.lock);
+  cp->next = *head;
+  *head = cp;
+  release(&pcache.lock);
+  return pa;
+
+bad:
+  acquire(&pcache.lock);
+  cp->ref = 0;
+  lruinsert(cp, 0);
+  release(&pcache.lock);
+  return 0;
+}
+
+// Count another mapping of cached page pa.
+void
+pcachedup(uint64 pa)
+{
+  struct cpage *cp;
+
+  acquire(&pcache.lock);
+  if((cp = pfindpa(pa)) == 0 || cp->ref < 1)
+    panic("pcachedup");
+  cp->ref++;
+  release(&pcache.lock);
+}
+
+// Drop a mapping of cached page pa.
+void
+pcacheput(uint64 pa)
+{
+  struct cpage *cp;
+
+  acquire(&pcache.lock);
+  if((cp = pfindpa(pa)) == 0 || cp->ref < 1)
+    panic("pcacheput");
+  if(--cp->ref == 0){
+    if(cp->stale)
+      pdrop(cp);
+    lruinsert(cp, cp->pa != 0);
+  }
+  release(&pcache.lock);
+}
+
+// writei() wrote the n bytes at src to ip at offset off,
+// all in one page; copy them into the page if it's cached.
+void
+pcachewrite(struct inode *ip, uint off, void *src, uint n)
+{
+  struct cpage *cp;
+
+  acquire(&pcache.lock);
+  if((cp = pfind(ip, off / PGSIZE)) != 0)
+    memmove((char*)cp->pa + off % PGSIZE, src, n);
+  release(&pcache.lock);
+}
+
+// ip is being truncated: forget its pages.
+void
+pcachetrunc(struct inode *ip)
+{
+  struct cpage *cp;
+
+  acquire(&pcache.lock);
+  for(cp = pcache.page; cp < &pcache.page[NPCACHE]; cp++){
+    if(cp->pa == 0 || cp->stale || cp->dev != ip->dev || cp->inum != ip->inum)
+      continue;
+    if(cp->ref == 0){
+      pdrop(cp);
+      lruremove(cp);
+      lruinsert(cp, 0);
+    } else {
+      cp->stale = 1;
+    }
+  }
+  release(&pcache.lock);
+}
@@ -7,18 +7,47 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "fcntl.h"
+#include "memstat.h"
 
-#define PIPESIZE 512
+// A pipe's buffer is a ring of npage pages, a power of two so
+// that byte offsets stay consistent when nread and nwrite wrap.
+// fcntl(F_SETPIPE_SZ) resizes it.
+//
+// Each end can be put in gift mode (F_SETPIPE_GIFT), so one
+// end never changes what the other end's calls do to its
+// memory. In gift mode, whole pages move between the ring and
+// user memory by swapping PTEs instead of copying: a
+// page-aligned page of a write becomes a ring page, and the
+// writer gets the ring page that was there; a page-aligned
+// read of a whole page of the ring takes the ring page, and
+// the reader's page goes into the ring. The writer's buffer
+// then holds its own old data, or zeros if the page it gets
+// came from anyone else (owner), so no one's memory leaks to
+// a writer.
+#define PIPESIZE(pi) ((pi)->npage * PGSIZE)
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *page[PIPEMAXPG];       // the ring
+  int owner[PIPEMAXPG];        // page[i] holds only this pid's writes, or 0
+  int npage;
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
 };
 
+static void
+freepages(char **page, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(page[i])
+      kfree(page[i]);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,8 +57,13 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = (struct pipe*)kalloctype(KMEM_PIPE)) == 0)
     goto bad;
+  memset(pi->page, 0, sizeof(pi->page));
+  memset(pi->owner, 0, sizeof(pi->owner));
+  if((pi->page[0] = kalloctype(KMEM_PIPE)) == 0)
+    goto bad;
+  pi->npage = 1;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
@@ -39,10 +73,12 @@ pipealloc(struct file **f0, struct file **f1)
   (*f0)->readable = 1;
   (*f0)->writable = 0;
   (*f0)->pipe = pi;
+  (*f0)->gift = 0;
   (*f1)->type = FD_PIPE;
   (*f1)->readable = 0;
   (*f1)->writable = 1;
   (*f1)->pipe = pi;
+  (*f1)->gift = 0;
   return 0;
 
  bad:
@@ -68,15 +104,138 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
+    freepages(pi->page, pi->npage);
     kfree((char*)pi);
   } else
     release(&pi->lock);
 }
 
+// Make the ring n bytes, rounded up to a power of two pages,
+// keeping what's buffered. Fails if that doesn't fit.
+static int
+piperesize(struct pipe *pi, int n)
+{
+  char *page[PIPEMAXPG];
+  int npage, i;
+  uint len, off, m;
+
+  if(n <= 0 || n > PIPEMAXPG * PGSIZE)
+    return -1;
+  for(npage = 1; npage * PGSIZE < n; npage *= 2)
+    ;
+  len = pi->nwrite - pi->nread;
+  if(len > npage * PGSIZE)
+    return -1;
+
+  memset(page, 0, sizeof(page));
+  for(i = 0; i < npage; i++){
+    if((page[i] = kalloctype(KMEM_PIPE)) == 0){
+      freepages(page, npage);
+      return -1;
+    }
+  }
+  // copy the buffered bytes to the start of the new ring.
+  for(i = 0; i < len; i += m){
+    off = (pi->nread + i) % PIPESIZE(pi);
+    m = PGSIZE - off % PGSIZE;
+    if(m > PGSIZE - i % PGSIZE)
+      m = PGSIZE - i % PGSIZE;
+    if(m > len - i)
+      m = len - i;
+    memmove(page[i / PGSIZE] + i % PGSIZE,
+            pi->page[off / PGSIZE] + off % PGSIZE, m);
+  }
+  freepages(pi->page, pi->npage);
+  memmove(pi->page, page, sizeof(page));
+  memset(pi->owner, 0, sizeof(pi->owner));
+  pi->npage = npage;
+  pi->nread = 0;
+  pi->nwrite = len;
+  wakeup(&pi->nwrite);
+  return 0;
+}
+
+// fcntl() on end f of a pipe.
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipefcntl(struct file *f, int cmd, int arg)
+{
+  struct pipe *pi = f->pipe;
+  int r = -1;
+
+  acquire(&pi->lock);
+  switch(cmd){
+  case F_GETPIPE_SZ:
+    r = PIPESIZE(pi);
+    break;
+  case F_SETPIPE_SZ:
+    if(piperesize(pi, arg) == 0)
+      r = PIPESIZE(pi);
+    break;
+  case F_SETPIPE_GIFT:
+    f->gift = arg != 0;
+    r = 0;
+    break;
+  }
+  release(&pi->lock);
+  return r;
+}
+
+// How many bytes can move at once between the ring at offset
+// off, with avail bytes there to read or room to write, and
+// the user's buffer at va, with left bytes to go: stop at the
+// end of the ring's page and of the user's page, so each chunk
+// is one memmove() after one page table walk.
+static uint
+pipechunk(uint off, uint avail, uint64 va, uint left)
+{
+  uint m = left;
+
+  if(m > avail)
+    m = avail;
+  if(m > PGSIZE - off % PGSIZE)
+    m = PGSIZE - off % PGSIZE;
+  if(m > PGSIZE - va % PGSIZE)
+    m = PGSIZE - va % PGSIZE;
+  return m;
+}
+
+// Swap the user page at va with the ring's page at off, if a
+// whole page is to move (avail is the bytes to read, or the
+// room to write, at off) and va is an ordinary writable page
+// of the process's memory. Returns 0 if it swapped them.
+static int
+pipeflip(struct pipe *pi, uint64 va, uint left, uint off, uint avail,
+         int reading)
+{
+  pte_t *pte;
+  uint64 pa;
+  int i = off / PGSIZE, pid = myproc()->pid;
+
+  if(va % PGSIZE != 0 || left < PGSIZE ||
+     off % PGSIZE != 0 || avail < PGSIZE || va >= MAXVA)
+    return -1;
+  if((pte = walk(myproc()->pagetable, va, 0)) == 0 ||
+     (*pte & (PTE_V|PTE_U|PTE_W)) != (PTE_V|PTE_U|PTE_W) ||
+     (*pte & PTE_CACHE))
+    return -1;
+  if(!reading && pi->owner[i] != pid)
+    memset(pi->page[i], 0, PGSIZE);
+  pa = PTE2PA(*pte);
+  *pte = PA2PTE(pi->page[i]) | PTE_FLAGS(*pte);
+  sfence_vma();
+  kmemretype(pi->page[i], KMEM_USER);
+  kmemretype((void*)pa, KMEM_PIPE);
+  pi->page[i] = (char*)pa;
+  pi->owner[i] = reading ? 0 : pid;
+  return 0;
+}
+
+// Write n bytes at addr to pi, moving whole pages if gift.
+int
+pipewrite(struct pipe *pi, uint64 addr, int n, int gift)
 {
   int i = 0;
+  uint off, m, room;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
@@ -85,15 +244,24 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
-    if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
+    if(pi->nwrite == pi->nread + PIPESIZE(pi)){ //DOC: pipewrite-full
       wakeup(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
     } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-        break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      off = pi->nwrite % PIPESIZE(pi);
+      room = PIPESIZE(pi) - (pi->nwrite - pi->nread);
+      if(gift && pipeflip(pi, addr + i, n - i, off, room, 0) == 0){
+        m = PGSIZE;
+      } else {
+        m = pipechunk(off, room, addr + i, n - i);
+        if(copyin(pr->pagetable, pi->page[off / PGSIZE] + off % PGSIZE,
+                  addr + i, m) == -1)
+          break;
+        if(pi->owner[off / PGSIZE] != pr->pid)
+          pi->owner[off / PGSIZE] = 0;
+      }
+      pi->nwrite += m;
+      i += m;
     }
   }
   wakeup(&pi->nread);
@@ -102,12 +270,13 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
   return i;
 }
 
+// Read up to n bytes from pi to addr, moving whole pages if gift.
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+piperead(struct pipe *pi, uint64 addr, int n, int gift)
 {
   int i;
+  uint off, m, avail;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
@@ -117,12 +286,20 @@ piperead(struct pipe *pi, uint64 addr, int n)
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
+  for(i = 0; i < n; i += m){  //DOC: piperead-copy
     if(pi->nread == pi->nwrite)
       break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
-      break;
+    off = pi->nread % PIPESIZE(pi);
+    avail = pi->nwrite - pi->nread;
+    if(gift && pipeflip(pi, addr + i, n - i, off, avail, 1) == 0){
+      m = PGSIZE;
+    } else {
+      m = pipechunk(off, avail, addr + i, n - i);
+      if(copyout(pr->pagetable, addr + i,
+                 pi->page[off / PGSIZE] + off % PGSIZE, m) == -1)
+        break;
+    }
+    pi->nread += m;
   }
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
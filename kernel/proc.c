@@ -5,18 +5,89 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "memstat.h"
+#include "schedstat.h"
 
 struct cpu cpus[NCPU];
 
 struct proc proc[NPROC];
 
+// Per-hart queues of RUNNABLE processes.
+// A process is on at most one queue, and only while RUNNABLE.
+// A hart whose own queue is empty steals from the longest
+// other queue. Lock order: p->lock, then a run queue lock.
+//
+// Each queue is split by scheduling class (see sched_class
+// below). Any SCHED_PRIO process runs before any SCHED_FAIR one.
+struct runq {
+  struct spinlock lock;
+  int len;
+
+  // SCHED_PRIO: a FIFO per priority level.
+  struct proc *prio[NPRIO];
+  struct proc *priotail[NPRIO];
+  int nprio;
+
+  // SCHED_FAIR: sorted by vruntime, smallest first.
+  struct proc *fair;
+  int nfair;
+  uint64 minvruntime;  // never decreases
+
+  int tickless;        // timer stopped by timer_stop()?
+
+  struct cpustat stat;
+} runq[NCPU];
+
+// How far behind a queue's minvruntime a waking
+// SCHED_FAIR process may start, in timer cycles.
+// Lets sleepers run soon without starving the rest.
+#define FAIRBONUS TICKCYCLES
+
+// Weight of each nice value, from NICE_MIN to NICE_MAX.
+// Each step is about 1.25x, so one nice level is
+// about a 10% difference in CPU share.
+static const int niceweight[NICE_MAX - NICE_MIN + 1] = {
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+   9548,  7620,  6100,  4904,  3906,
+   3121,  2501,  1991,  1586,  1277,
+   1024,   820,   655,   526,   423,
+    335,   272,   215,   172,   137,
+    110,    87,    70,    56,    45,
+     36,    29,    23,    18,    15,
+};
+
+// Processes in sleep(), hashed by wait channel, so that
+// wakeup() only looks at processes that might be
+// waiting on its channel. A bucket holds every channel
+// that hashes to it. Lock order: the caller's condition
+// lock, then a wait queue lock, then p->lock.
+#define NWAITQ 64
+
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+} waitq[NWAITQ];
+
+static struct waitq*
+chanq(void *chan)
+{
+  uint64 h = (uint64)chan;
+
+  h ^= h >> 12;
+  return &waitq[(h >> 3) % NWAITQ];
+}
+
 struct proc *initproc;
 
 int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
+static void spawnret(void);
 static void freeproc(struct proc *p);
+static void kprocstart(void);
+static void charge(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -34,7 +105,7 @@ proc_mapstacks(pagetable_t kpgtbl) {
   struct proc *p;
   
   for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
+    char *pa = kalloctype(KMEM_KSTACK);
     if(pa == 0)
       panic("kalloc");
     uint64 va = KSTACK((int) (p - proc));
@@ -50,6 +121,10 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+  for(int i = 0; i < NWAITQ; i++)
+    initlock(&waitq[i].lock, "waitq");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->kstack = KSTACK((int) (p - proc));
@@ -101,8 +176,10 @@ allocpid() {
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
 // If there are no free procs, or a memory allocation fails, return 0.
+// Kernel processes (see kproc()) get pid 0, so they don't
+// shift the pids of init and the shell.
 static struct proc*
-allocproc(void)
+allocproc(int kernel)
 {
 
   struct proc *p;
@@ -118,11 +195,17 @@ allocproc(void)
   return 0;
 
 found:
-  p->pid = allocpid();
+  p->pid = kernel ? 0 : allocpid();
   p->state = USED;
+  p->cpu = cpuid();
+  p->policy = SCHED_FAIR;
+  p->prio = 0;
+  p->nice = NICE_DEFAULT;
+  p->runtime = 0;
+  p->vruntime = 0;
 
   // Allocate a trapframe page.
-  if((p->trapframe = (struct trapframe *)kalloc()) == 0){
+  if((p->trapframe = (struct trapframe *)kalloctype(KMEM_TRAPFRAME)) == 0){
     freeproc(p);
     release(&p->lock);
     return 0;
@@ -248,7 +331,7 @@ userinit(void)
 {
   struct proc *p;
 
-  p = allocproc();
+  p = allocproc(0);
   initproc = p;
   
   // allocate one user page and copy init's instructions
@@ -263,7 +346,25 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
+
+  release(&p->lock);
+}
+
+// Start a kernel process that runs fn() and never
+// returns to user space.
+void
+kproc(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc(1)) == 0)
+    panic("kproc");
+  p->kfn = fn;
+  p->context.ra = (uint64)kprocstart;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  setrunnable(p);
 
   release(&p->lock);
 }
@@ -298,7 +399,7 @@ fork(void)
   struct proc *p = myproc();
 
   // Allocate process.
-  if((np = allocproc()) == 0){
+  if((np = allocproc(0)) == 0){
     return -1;
   }
 
@@ -308,6 +409,15 @@ fork(void)
     release(&np->lock);
     return -1;
   }
+  if(mmapcopy(np, p) < 0){
+    // munmapall() may sleep; no one else uses np yet.
+    release(&np->lock);
+    munmapall(np);
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
 
 
   #ifndef NONE
@@ -315,11 +425,7 @@ fork(void)
   struct page* pg;
   if (np->pid > 2)
   {
-    release(&np->lock);
-    release(&p->lock);
-    createSwapFile(np);
-    acquire(&p->lock);
-    acquire(&np->lock);
+    // np's swap file is created by its first write.
     int index = 0;
     for(pg = p->swapped_pages ; pg < &p->swapped_pages[MAX_PSYC_PAGES] ; pg++)
     {
@@ -329,7 +435,8 @@ fork(void)
         release(&np->lock);
         release(&p->lock);
         readFromSwapFile(p, mem, index*PGSIZE, PGSIZE);
-        writeToSwapFile(np, mem, index*PGSIZE, PGSIZE);
+        if(writeToSwapFile(np, mem, index*PGSIZE, PGSIZE) < 0)
+          panic("failed to write to swap file.");
         acquire(&p->lock);
         acquire(&np->lock);
         kfree(mem);
@@ -364,6 +471,13 @@ fork(void)
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
+  // inherit the scheduling class; start with the parent's
+  // vruntime, so forking doesn't buy extra CPU time.
+  np->policy = p->policy;
+  np->prio = p->prio;
+  np->nice = p->nice;
+  np->vruntime = p->vruntime;
+
   pid = np->pid;
 
   release(&np->lock);
@@ -373,12 +487,94 @@ fork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
 }
 
+// What spawn() hands the new process, which runs exec() as its
+// first act, in its own context.
+struct spawnreq {
+  char *path;
+  char **argv;
+  int done;  // exec() succeeded
+};
+
+// Create a process running the program path with arguments
+// argv, without copying the caller's memory. If files is 0 the
+// child shares all the caller's open files, as after fork();
+// otherwise its descriptor i is files[i], for i < NSPAWNFD, or
+// closed if files[i] is 0, and it gets no others.
+// Waits until the child has loaded the program. Returns the
+// child's pid, or -1 if it couldn't be created or exec()
+// failed, in which case it's already been reaped.
+int
+spawn(char *path, char **argv, struct file **files)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+  struct spawnreq req;
+
+  if((np = allocproc(0)) == 0)
+    return -1;
+
+  req.path = path;
+  req.argv = argv;
+  req.done = 0;
+  np->spawnreq = &req;
+  np->context.ra = (uint64)spawnret;
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+
+  for(i = 0; i < NOFILE; i++){
+    if(files == 0 && p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+    else if(files && i < NSPAWNFD && files[i])
+      np->ofile[i] = filedup(files[i]);
+  }
+  np->cwd = idup(p->cwd);
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  // inherit the scheduling class, as fork() does.
+  np->policy = p->policy;
+  np->prio = p->prio;
+  np->nice = p->nice;
+  np->vruntime = p->vruntime;
+
+  pid = np->pid;
+
+  release(&np->lock);
+
+  acquire(&wait_lock);
+  np->parent = p;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  setrunnable(np);
+  release(&np->lock);
+
+  // Wait for the child to load the program, or to exit if it
+  // couldn't. Both wake us the way exit() wakes wait().
+  acquire(&wait_lock);
+  for(;;){
+    if(req.done){
+      release(&wait_lock);
+      return pid;
+    }
+    acquire(&np->lock);
+    if(np->state == ZOMBIE){
+      freeproc(np);
+      release(&np->lock);
+      release(&wait_lock);
+      return -1;
+    }
+    release(&np->lock);
+    sleep(p, &wait_lock);
+  }
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold wait_lock.
 void
@@ -405,6 +601,8 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  munmapall(p);
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -434,6 +632,7 @@ exit(int status)
 
   p->xstate = status;
   p->state = ZOMBIE;
+  charge(p);
 
   release(&wait_lock);
 
@@ -492,10 +691,365 @@ wait(uint64 addr)
   }
 }
 
+// Send an IPI to get idle CPU id out of wfi.
+// Does nothing if id is not idle, or someone
+// else has already kicked it.
+static void
+kick(int id)
+{
+  struct cpu *c = &cpus[id];
+
+  if(!__sync_bool_compare_and_swap(&c->idle, 1, 0))
+    return;
+  c->kicktime = r_time();
+  runq[cpuid()].stat.nipi++;
+  __sync_synchronize();
+  *(volatile uint32*)CLINT_MSIP(id) = 1;
+}
+
+// Process p has just been put on CPU id's run queue;
+// get an idle CPU to run it: id itself, or else one
+// that can steal it. No need when p is this CPU's own
+// process yielding, since this CPU is about to
+// schedule again anyway.
+static void
+wakeidle(struct proc *p, int id)
+{
+  int me = cpuid();
+
+  if(id == me && p == mycpu()->proc)
+    return;
+  if(id != me && cpus[id].idle){
+    kick(id);
+    return;
+  }
+  for(int i = 0; i < NCPU; i++){
+    if(i != me && i != id && cpus[i].idle){
+      kick(i);
+      return;
+    }
+  }
+}
+
+// Tickless mode (make TICKLESS=1).
+// A CPU has no use for timer interrupts while it is idle,
+// or while it runs a process with nothing else queued
+// behind it, so it stops its timer; setrunnable()
+// restarts it when a second process arrives. Supervisor
+// mode writes the CLINT's MTIMECMP directly; timervec
+// keeps adding the tick interval once it is running again.
+// CPU 0 always ticks, to advance ticks for sleep().
+// Caller must hold rq->lock.
+static void
+timer_stop(struct runq *rq)
+{
+#ifdef TICKLESS
+  int id = rq - runq;
+
+  if(id == 0 || rq->tickless)
+    return;
+  rq->tickless = 1;
+  *(volatile uint64*)CLINT_MTIMECMP(id) = 0xffffffffffffffffull;
+#endif
+}
+
+static void
+timer_start(struct runq *rq)
+{
+#ifdef TICKLESS
+  int id = rq - runq;
+
+  if(!rq->tickless)
+    return;
+  rq->tickless = 0;
+  *(volatile uint64*)CLINT_MTIMECMP(id) = *(volatile uint64*)CLINT_MTIME + TICKCYCLES;
+  rq->stat.ntimerstart++;
+#endif
+}
+
+// Should a timer interrupt make this CPU's process yield?
+// In tickless mode, not if nothing else is queued here,
+// since the scheduler would just pick it again. Otherwise
+// always, so that the page aging in scheduler() runs.
+int
+needresched(void)
+{
+#ifdef TICKLESS
+  int r;
+
+  push_off();
+  r = runq[cpuid()].len > 0;
+  pop_off();
+  return r;
+#else
+  return 1;
+#endif
+}
+
+// Scheduling classes.
+// enqueue() adds p to rq; pick() removes and returns
+// the process the class would run next, or 0;
+// charge() bills p for ran timer cycles on the CPU.
+// Callers of enqueue() and pick() hold rq->lock;
+// callers of charge() hold p->lock.
+struct sched_class {
+  void (*enqueue)(struct runq *rq, struct proc *p);
+  struct proc *(*pick)(struct runq *rq);
+  void (*charge)(struct proc *p, uint64 ran);
+};
+
+static void
+prio_enqueue(struct runq *rq, struct proc *p)
+{
+  int i = p->prio;
+
+  p->rqnext = 0;
+  if(rq->priotail[i])
+    rq->priotail[i]->rqnext = p;
+  else
+    rq->prio[i] = p;
+  rq->priotail[i] = p;
+  rq->nprio++;
+}
+
+static struct proc*
+prio_pick(struct runq *rq)
+{
+  struct proc *p;
+
+  if(rq->nprio == 0)
+    return 0;
+  for(int i = NPRIO-1; i >= 0; i--){
+    if((p = rq->prio[i]) != 0){
+      rq->prio[i] = p->rqnext;
+      if(rq->prio[i] == 0)
+        rq->priotail[i] = 0;
+      rq->nprio--;
+      return p;
+    }
+  }
+  panic("prio_pick");
+}
+
+static void
+prio_charge(struct proc *p, uint64 ran)
+{
+}
+
+static void
+fair_enqueue(struct runq *rq, struct proc *p)
+{
+  struct proc **pp;
+
+  if(p->vruntime + FAIRBONUS < rq->minvruntime)
+    p->vruntime = rq->minvruntime - FAIRBONUS;
+  for(pp = &rq->fair; *pp && (*pp)->vruntime <= p->vruntime; pp = &(*pp)->rqnext)
+    ;
+  p->rqnext = *pp;
+  *pp = p;
+  rq->nfair++;
+}
+
+static struct proc*
+fair_pick(struct runq *rq)
+{
+  struct proc *p;
+
+  if((p = rq->fair) == 0)
+    return 0;
+  rq->fair = p->rqnext;
+  rq->nfair--;
+  if(p->vruntime > rq->minvruntime)
+    rq->minvruntime = p->vruntime;
+  return p;
+}
+
+// virtual runtime advances more slowly for
+// heavier (lower nice) processes.
+static void
+fair_charge(struct proc *p, uint64 ran)
+{
+  p->vruntime += ran * niceweight[NICE_DEFAULT - NICE_MIN] /
+                 niceweight[p->nice - NICE_MIN];
+}
+
+// in the order pickproc() tries them.
+static struct sched_class sched_classes[] = {
+[SCHED_PRIO]  { prio_enqueue, prio_pick, prio_charge },
+[SCHED_FAIR]  { fair_enqueue, fair_pick, fair_charge },
+};
+
+// Bill the current process p for its time on the CPU since
+// scheduler() switched to it. Called just before it gives up
+// the CPU, and before yield() queues it again, since a queued
+// process's vruntime is its place in the queue.
+// Caller must hold p->lock.
+static void
+charge(struct proc *p)
+{
+  uint64 ran = r_time() - p->runstart;
+
+  p->runtime += ran;
+  sched_classes[p->policy].charge(p, ran);
+  p->runstart += ran;
+}
+
+// Mark p RUNNABLE and add it to the run queue
+// of the hart it last ran on.
+// Caller must hold p->lock.
+void
+setrunnable(struct proc *p)
+{
+  struct runq *rq;
+
+  if(!holding(&p->lock))
+    panic("setrunnable");
+
+  p->state = RUNNABLE;
+  rq = &runq[p->cpu];
+  acquire(&rq->lock);
+  sched_classes[p->policy].enqueue(rq, p);
+  rq->len++;
+  if(rq->len > rq->stat.maxqlen)
+    rq->stat.maxqlen = rq->len;
+  timer_start(rq);
+  release(&rq->lock);
+
+  wakeidle(p, p->cpu);
+}
+
+// Remove and return the process rq should run next, or 0.
+// Caller must hold rq->lock.
+static struct proc*
+runqpop(struct runq *rq)
+{
+  struct proc *p;
+
+  for(int i = 0; i < NELEM(sched_classes); i++){
+    if((p = sched_classes[i].pick(rq)) != 0){
+      p->rqnext = 0;
+      rq->len--;
+      return p;
+    }
+  }
+  return 0;
+}
+
+// Take a process off the longest other hart's queue.
+// The lengths are read without locks; a stale
+// value only costs a wasted attempt.
+static struct proc*
+steal(int id)
+{
+  struct runq *rq, *victim = 0;
+  struct proc *p;
+  uint64 mymin;
+
+  for(rq = runq; rq < &runq[NCPU]; rq++){
+    if(rq == &runq[id] || rq->len == 0)
+      continue;
+    if(victim == 0 || rq->len > victim->len)
+      victim = rq;
+  }
+  if(victim == 0)
+    return 0;
+
+  acquire(&runq[id].lock);
+  mymin = runq[id].minvruntime;
+  release(&runq[id].lock);
+
+  // vruntimes only compare within one queue, so rebase p's
+  // on this one. No one else changes a queued process's
+  // vruntime, and p can't run until we return it.
+  acquire(&victim->lock);
+  if((p = runqpop(victim)) != 0){
+    victim->stat.nstolen++;
+    if(p->vruntime + mymin >= victim->minvruntime)
+      p->vruntime = p->vruntime + mymin - victim->minvruntime;
+    else
+      p->vruntime = 0;
+  }
+  release(&victim->lock);
+  if(p)
+    runq[id].stat.nsteal++;
+  return p;
+}
+
+// Choose the next process for hart id to run:
+// the head of its own queue, else one stolen from
+// another hart. Returns 0 if nothing is runnable.
+static struct proc*
+pickproc(int id)
+{
+  struct runq *rq = &runq[id];
+  struct proc *p;
+
+  acquire(&rq->lock);
+  p = runqpop(rq);
+  release(&rq->lock);
+  if(p == 0)
+    p = steal(id);
+  return p;
+}
+
+// Is any run queue non-empty?
+static int
+anyrunnable(void)
+{
+  for(struct runq *rq = runq; rq < &runq[NCPU]; rq++)
+    if(rq->len > 0)
+      return 1;
+  return 0;
+}
+
+// Nothing to run: wait in wfi for an interrupt,
+// such as an IPI from kick().
+// Announce idleness before the final check for work,
+// so that a process queued after the check is sure
+// to kick this CPU. Interrupts are off across the
+// check and the wfi, so that the IPI can't be
+// taken (and lost) in between; wfi returns when an
+// interrupt is pending even with interrupts off.
+static void
+idle(int id)
+{
+  struct cpu *c = &cpus[id];
+  struct cpustat *st = &runq[id].stat;
+  uint64 t0, t1;
+
+  intr_off();
+#ifdef TICKLESS
+  acquire(&runq[id].lock);
+  timer_stop(&runq[id]);
+  release(&runq[id].lock);
+#endif
+  c->idle = 1;
+  __sync_synchronize();
+  if(!anyrunnable()){
+    t0 = r_time();
+    wfi();
+    t1 = r_time();
+    st->nidle++;
+    st->idletime += t1 - t0;
+    if(c->idle == 0 && c->kicktime != 0 && c->kicktime <= t1){
+      // woken by kick().
+      st->nwake++;
+      st->wakelat += t1 - c->kicktime;
+      if(t1 - c->kicktime > st->maxwakelat)
+        st->maxwakelat = t1 - c->kicktime;
+    }
+  }
+  c->idle = 0;
+  c->kicktime = 0;
+  intr_on();
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - take a process off this CPU's run queue,
+//    or steal one from another CPU's,
+//    or wait for an interrupt if there is none.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -504,47 +1058,85 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
-  
+  int id = cpuid();
+
   c->proc = 0;
+  runq[id].stat.online = 1;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-        #ifndef NONE
-        #ifndef SCFIFO
-        for(struct page* pg = p->psyc_pages; pg < &p->psyc_pages[MAX_PSYC_PAGES]; pg++){
-          if(pg->state == UNUSEDPG){
-            continue;
-          }
-          pte_t* pte = walk(p->pagetable, pg->va, 0);
-          if(PTE_A & *pte){ 
-            pg->counter = (pg->counter >> 1) | 1 << ((sizeof(uint)*8)-1);
-            *pte &= ~PTE_A;
-          }
-          else{
-            pg->counter = (pg->counter >> 1);
-          }
+    if((p = pickproc(id)) == 0){
+      idle(id);
+      continue;
+    }
+
+    // p is off every run queue, so no other CPU
+    // can pick it; p->lock waits out the swtch()
+    // away from p if it was only just queued.
+    acquire(&p->lock);
+    if(p->state == RUNNABLE) {
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      p->state = RUNNING;
+      p->cpu = id;
+      c->proc = p;
+      runq[id].stat.nsched++;
+#ifdef TICKLESS
+      // no one to time-slice against: run p without ticks.
+      acquire(&runq[id].lock);
+      if(runq[id].len == 0)
+        timer_stop(&runq[id]);
+      else
+        timer_start(&runq[id]);
+      release(&runq[id].lock);
+#endif
+      p->runstart = r_time();
+      swtch(&c->context, &p->context);
+      #ifndef NONE
+      #ifndef SCFIFO
+      for(struct page* pg = p->psyc_pages; pg < &p->psyc_pages[MAX_PSYC_PAGES]; pg++){
+        if(pg->state == UNUSEDPG){
+          continue;
+        }
+        pte_t* pte = walk(p->pagetable, pg->va, 0);
+        if(PTE_A & *pte){ 
+          pg->counter = (pg->counter >> 1) | 1 << ((sizeof(uint)*8)-1);
+          *pte &= ~PTE_A;
+        }
+        else{
+          pg->counter = (pg->counter >> 1);
         }
-        #endif
-        #endif
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
       }
-      release(&p->lock);
+      #endif
+      #endif
+      // Process is done running for now.
+      // It should have changed its p->state before coming back.
+      c->proc = 0;
     }
+    release(&p->lock);
   }
 }
 
+// Copy out per-CPU run queue statistics for up to n CPUs.
+// Returns the number of entries filled in.
+int
+schedstat(struct cpustat *st, int n)
+{
+  int i;
+
+  if(n > NCPU)
+    n = NCPU;
+  for(i = 0; i < n; i++){
+    acquire(&runq[i].lock);
+    st[i] = runq[i].stat;
+    st[i].qlen = runq[i].len;
+    release(&runq[i].lock);
+  }
+  return n;
+}
+
 // Switch to scheduler.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
@@ -578,7 +1170,8 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  charge(p);  // before its place in a run queue depends on it
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
@@ -604,34 +1197,92 @@ forkret(void)
   usertrapret();
 }
 
+// A spawn() child's very first scheduling by scheduler()
+// will swtch to spawnret, which loads the program before
+// the first return to user space.
+static void
+spawnret(void)
+{
+  struct proc *p = myproc();
+  struct spawnreq *req = p->spawnreq;
+  int argc;
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  if((argc = exec(req->path, req->argv)) < 0)
+    exit(-1);
+  p->trapframe->a0 = argc;
+
+  // req is on the parent's stack; it's gone once we wake it.
+  acquire(&wait_lock);
+  p->spawnreq = 0;
+  req->done = 1;
+  wakeup(p->parent);
+  release(&wait_lock);
+
+  usertrapret();
+}
+
+// A kernel process's very first scheduling by scheduler()
+// will swtch to kprocstart.
+static void
+kprocstart(void)
+{
+  // Still holding p->lock from scheduler.
+  release(&myproc()->lock);
+
+  myproc()->kfn();
+  panic("kproc returned");
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq = chanq(chan);
+  struct proc **pp;
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
+  // Once we are on chan's wait queue, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // (wakeup locks the wait queue, then p->lock),
   // so it's okay to release lk.
 
+  acquire(&wq->lock);
   acquire(&p->lock);  //DOC: sleeplock1
   release(lk);
 
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->wqnext = wq->head;
+  p->onwaitq = 1;
+  wq->head = p;
+  release(&wq->lock);
 
+  charge(p);
   sched();
 
   // Tidy up.
   p->chan = 0;
+  release(&p->lock);
+
+  // kill() wakes a process without taking it
+  // off its wait queue.
+  acquire(&wq->lock);
+  if(p->onwaitq){
+    for(pp = &wq->head; *pp != p; pp = &(*pp)->wqnext)
+      ;
+    *pp = p->wqnext;
+    p->onwaitq = 0;
+  }
+  release(&wq->lock);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
@@ -639,18 +1290,76 @@ sleep(void *chan, struct spinlock *lk)
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
+{
+  struct waitq *wq = chanq(chan);
+  struct proc *p, **pp;
+
+  acquire(&wq->lock);
+  for(pp = &wq->head; (p = *pp) != 0; ){
+    acquire(&p->lock);
+    if(p->chan == chan){
+      *pp = p->wqnext;
+      p->onwaitq = 0;
+      if(p->state == SLEEPING)
+        setrunnable(p);
+    } else {
+      pp = &p->wqnext;
+    }
+    release(&p->lock);
+  }
+  release(&wq->lock);
+}
+
+// Set the scheduling class of the process with the given pid.
+// prio is a priority for SCHED_PRIO, a nice value for SCHED_FAIR.
+// Takes effect the next time the process is queued to run.
+int
+setpriority(int pid, int policy, int prio)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
+  if(pid <= 0)
+    return -1;  // leave kernel processes alone
+  if(policy == SCHED_PRIO && (prio < 0 || prio >= NPRIO))
+    return -1;
+  if(policy == SCHED_FAIR && (prio < NICE_MIN || prio > NICE_MAX))
+    return -1;
+  if(policy != SCHED_PRIO && policy != SCHED_FAIR)
+    return -1;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      p->policy = policy;
+      if(policy == SCHED_PRIO)
+        p->prio = prio;
+      else
+        p->nice = prio;
       release(&p->lock);
+      return 0;
     }
+    release(&p->lock);
   }
+  return -1;
+}
+
+// Add incr to the current process's nice value.
+// Returns the new nice value.
+int
+nice(int incr)
+{
+  struct proc *p = myproc();
+  int n;
+
+  acquire(&p->lock);
+  n = p->nice + incr;
+  if(n < NICE_MIN)
+    n = NICE_MIN;
+  if(n > NICE_MAX)
+    n = NICE_MAX;
+  p->nice = n;
+  release(&p->lock);
+  return n;
 }
 
 // Kill the process with the given pid.
@@ -661,13 +1370,16 @@ kill(int pid)
 {
   struct proc *p;
 
+  if(pid <= 0)
+    return -1;  // kernel processes can't be killed
+
   for(p = proc; p < &proc[NPROC]; p++){
     acquire(&p->lock);
     if(p->pid == pid){
       p->killed = 1;
       if(p->state == SLEEPING){
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        setrunnable(p);
       }
       release(&p->lock);
       return 0;
@@ -732,6 +1444,17 @@ procdump(void)
     else
       state = "???";
     printf("%d %s %s", p->pid, state, p->name);
+    printf(" %s %d %dms", p->policy == SCHED_PRIO ? "prio" : "nice",
+           p->policy == SCHED_PRIO ? p->prio : p->nice,
+           (int)(p->runtime / (TIMERFREQ / 1000)));
     printf("\n");
   }
+  for(int i = 0; i < NCPU; i++){
+    struct runq *rq = &runq[i];
+    if(!rq->stat.online)
+      continue;
+    printf("cpu %d: runq %d sched %d steal %d stolen %d idle %d ipi %d\n",
+           i, rq->len, (int)rq->stat.nsched, (int)rq->stat.nsteal,
+           (int)rq->stat.nstolen, (int)rq->stat.nidle, (int)rq->stat.nipi);
+  }
 }
\ No newline at end of file
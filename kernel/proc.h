@@ -27,6 +27,8 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int idle;                   // In wfi, waiting for an IPI from kick()?
+  uint64 kicktime;            // When kick() sent the IPI.
 };
 
 extern struct cpu cpus[NCPU];
@@ -83,6 +85,16 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// A region of a file mapped by mmap(), or a program's text.
+struct vma {
+  uint64 addr;       // page-aligned start
+  uint64 len;        // bytes, a multiple of PGSIZE
+  int prot;          // PROT_*
+  int flags;         // MAP_SHARED or MAP_PRIVATE
+  struct inode *ip;  // 0 if the slot is free
+  uint off;          // file offset of addr, a multiple of PGSIZE
+};
+
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 enum pagestate { UNUSEDPG, USEDPG };
 struct page {
@@ -102,6 +114,20 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int cpu;                     // Hart whose run queue p goes on
+  int policy;                  // Scheduling class, SCHED_*
+  int prio;                    // Priority, for SCHED_PRIO
+  int nice;                    // Nice value, for SCHED_FAIR
+  uint64 runtime;              // Time spent running, in timer cycles
+  uint64 vruntime;             // Weighted runtime, for SCHED_FAIR
+  uint64 runstart;             // When it was last switched to, in timer cycles
+
+  // the run queue lock must be held when using this:
+  struct proc *rqnext;         // Next RUNNABLE process in run queue
+
+  // the wait queue lock for chan must be held when using these:
+  struct proc *wqnext;         // Next process in chan's wait queue
+  int onwaitq;                 // Still on chan's wait queue?
 
   // proc_tree_lock must be held when using this:
   struct proc *parent;         // Parent process
@@ -115,9 +141,15 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  void (*kfn)(void);           // kproc() body, for kernel processes
+  struct spawnreq *spawnreq;   // what spawn() asked this process to run
+  int logres;                  // log blocks reserved by begin_opn(), or 0
+  int nilock;                  // inode locks held, by ilock()
+  struct vma vma[NVMA];        // mmap()ed files
   
   struct page swapped_pages[MAX_TOTAL_PAGES - MAX_PSYC_PAGES];
   struct page psyc_pages[MAX_PSYC_PAGES];
 
   struct file *swapFile;
+  char swapPath[16];           // swapFile's name, for unlinking it
 };
@@ -248,6 +248,19 @@ r_mcounteren()
   return x;
 }
 
+// Physical Memory Protection
+static inline void
+w_pmpcfg0(uint64 x)
+{
+  asm volatile("csrw pmpcfg0, %0" : : "r" (x));
+}
+
+static inline void
+w_pmpaddr0(uint64 x)
+{
+  asm volatile("csrw pmpaddr0, %0" : : "r" (x));
+}
+
 // machine-mode cycle counter
 static inline uint64
 r_time()
@@ -257,6 +270,15 @@ r_time()
   return x;
 }
 
+// processor clock cycles
+static inline uint64
+r_cycle()
+{
+  uint64 x;
+  asm volatile("csrr %0, cycle" : "=r" (x) );
+  return x;
+}
+
 // enable device interrupts
 static inline void
 intr_on()
@@ -311,6 +333,14 @@ r_ra()
   return x;
 }
 
+// stall this hart until an interrupt is pending.
+// returns even if interrupts are disabled.
+static inline void
+wfi()
+{
+  asm volatile("wfi");
+}
+
 // flush the TLB.
 static inline void
 sfence_vma()
@@ -334,6 +364,7 @@ sfence_vma()
 #define PTE_U (1L << 4) // 1 -> user can access
 #define PTE_A (1L << 6)
 #define PTE_D (1L << 7)
+#define PTE_CACHE (1L << 8) // maps a page cache page; see mmap.c. without PTE_V: see uvmlazy()
 #define PTE_PG (1L << 9) // Paged out to secondary storage
 
 // shift a physical address to the right place for a PTE.
@@ -0,0 +1,29 @@
+// Scheduling classes and per-CPU scheduler statistics.
+// Both the kernel and user programs use this header file.
+
+// scheduling classes, for setpriority().
+#define SCHED_PRIO  0   // fixed priority; runs before any SCHED_FAIR
+#define SCHED_FAIR  1   // CPU shared in proportion to nice weight
+
+#define NPRIO         8   // SCHED_PRIO priorities 0..NPRIO-1, higher first
+#define NICE_MIN    -20   // SCHED_FAIR nice values; lower gets more CPU
+#define NICE_MAX     19
+#define NICE_DEFAULT  0
+
+// filled in by the schedstat() system call.
+
+struct cpustat {
+  int online;       // has this CPU entered scheduler()?
+  int qlen;         // processes now on its run queue
+  uint64 maxqlen;   // longest its run queue has been
+  uint64 nsched;    // processes it has switched to
+  uint64 nsteal;    // processes it took from other CPUs' queues
+  uint64 nstolen;   // processes other CPUs took from its queue
+  uint64 nidle;     // times it waited in wfi for work
+  uint64 idletime;  // time spent in wfi, in timer cycles
+  uint64 nipi;      // IPIs it sent to wake idle CPUs
+  uint64 nwake;     // times an IPI woke it from wfi
+  uint64 wakelat;   // total IPI send-to-wake latency, in timer cycles
+  uint64 maxwakelat;// worst IPI send-to-wake latency
+  uint64 ntimerstart;// times a tickless timer was restarted
+};
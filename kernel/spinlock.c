@@ -7,13 +7,71 @@
 #include "riscv.h"
 #include "proc.h"
 #include "defs.h"
+#include "lockstat.h"
+
+// Contention statistics, one entry per distinct lock name.
+// Counters are updated with atomic adds, since locks with the
+// same name are acquired concurrently by different CPUs.
+#define NLOCKCLASS 32
+
+struct lockclass {
+  char *name;
+  uint64 nlock;
+  uint64 nacquire;
+  uint64 ncontend;
+  uint64 nspin;
+  uint64 holdtime;
+  uint64 maxhold;
+};
+
+// the last entry is kept for names that don't fit.
+static struct lockclass lockclass[NLOCKCLASS] = {
+  [NLOCKCLASS-1] = { .name = "other" },
+};
+static int nlockclass;  // entries in use, counting "other" once used
+static uint lockclasslock;  // can't be a spinlock; initlock() takes it
+
+// find or create the statistics entry for locks called name.
+// once the table is full, further names share the "other" entry.
+static struct lockclass *
+lookupclass(char *name)
+{
+  struct lockclass *c;
+
+  push_off();
+  while(__sync_lock_test_and_set(&lockclasslock, 1) != 0)
+    ;
+  for(c = lockclass; c < &lockclass[nlockclass]; c++)
+    if(strncmp(c->name, name, LOCKNAME) == 0)
+      break;
+  if(c == &lockclass[nlockclass]){
+    if(nlockclass < NLOCKCLASS-1){
+      nlockclass++;
+      c->name = name;
+    } else {
+      nlockclass = NLOCKCLASS;
+      c = &lockclass[NLOCKCLASS-1];
+    }
+  }
+  c->nlock++;
+  __sync_lock_release(&lockclasslock);
+  pop_off();
+  return c;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
+#ifdef TASLOCK
   lk->locked = 0;
+#else
+  lk->next = 0;
+  lk->owner = 0;
+#endif
   lk->cpu = 0;
+  lk->class = lookupclass(name);
+  lk->start = 0;
 }
 
 // Acquire the lock.
@@ -21,16 +79,31 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  struct lockclass *c = lk->class;
+  uint64 spins = 0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
+#ifdef TASLOCK
   // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
   while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+    spins++;
+#else
+  // Take a ticket and wait for it to be served. Unlike a
+  // test-and-set lock, waiters get the lock in arrival order,
+  // and while waiting they only read lk->owner, so the cache
+  // line isn't bounced between them with atomic writes.
+  // On RISC-V, sync_fetch_and_add turns into an atomic add:
+  //   amoadd.w a5, a5, (s1)
+  uint ticket = __sync_fetch_and_add(&lk->next, 1);
+  while(__atomic_load_n(&lk->owner, __ATOMIC_RELAXED) != ticket)
+    spins++;
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,15 +113,30 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+  lk->start = r_cycle();
+
+  __sync_fetch_and_add(&c->nacquire, 1);
+  if(spins){
+    __sync_fetch_and_add(&c->ncontend, 1);
+    __sync_fetch_and_add(&c->nspin, spins);
+  }
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  struct lockclass *c = lk->class;
+  uint64 hold;
+
   if(!holding(lk))
     panic("release");
 
+  hold = r_cycle() - lk->start;
+  __sync_fetch_and_add(&c->holdtime, hold);
+  if(hold > c->maxhold)
+    c->maxhold = hold;  // racy, but only ever loses a maximum
+
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -59,6 +147,7 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
+#ifdef TASLOCK
   // Release the lock, equivalent to lk->locked = 0.
   // This code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
@@ -67,6 +156,11 @@ release(struct spinlock *lk)
   //   s1 = &lk->locked
   //   amoswap.w zero, zero, (s1)
   __sync_lock_release(&lk->locked);
+#else
+  // Serve the next ticket. Only the holder writes lk->owner,
+  // but use an atomic add for the same reason as above.
+  __sync_fetch_and_add(&lk->owner, 1);
+#endif
 
   pop_off();
 }
@@ -77,10 +171,34 @@ int
 holding(struct spinlock *lk)
 {
   int r;
+#ifdef TASLOCK
   r = (lk->locked && lk->cpu == mycpu());
+#else
+  r = (lk->next != lk->owner && lk->cpu == mycpu());
+#endif
   return r;
 }
 
+// copy the statistics for the i'th lock name into *st.
+// returns -1 if there is no i'th name.
+int
+lockstat(int i, struct lockstat *st)
+{
+  struct lockclass *c;
+
+  if(i < 0 || i >= nlockclass)
+    return -1;
+  c = &lockclass[i];
+  safestrcpy(st->name, c->name, LOCKNAME);
+  st->nlock = c->nlock;
+  st->nacquire = c->nacquire;
+  st->ncontend = c->ncontend;
+  st->nspin = c->nspin;
+  st->holdtime = c->holdtime;
+  st->maxhold = c->maxhold;
+  return 0;
+}
+
 // push_off/pop_off are like intr_off()/intr_on() except that they are matched:
 // it takes two pop_off()s to undo two push_off()s.  Also, if interrupts
 // are initially off, then push_off, pop_off leaves them off.
@@ -1,9 +1,17 @@
 // Mutual exclusion lock.
 struct spinlock {
+#ifdef TASLOCK
   uint locked;       // Is the lock held?
+#else
+  uint next;         // Next ticket to hand out.
+  uint owner;        // Ticket now allowed to hold the lock.
+#endif
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
-};
 
+  // For lockstat():
+  struct lockclass *class;  // Statistics shared by locks with this name.
+  uint64 start;             // Cycle counter when acquired.
+};
@@ -11,7 +11,10 @@ void timerinit();
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
 // a scratch area per CPU for machine-mode timer interrupts.
-uint64 timer_scratch[NCPU][5];
+uint64 timer_scratch[NCPU][7];
+
+// timer_scratch[id][6] as of the last timerfired() on each CPU.
+static uint64 timer_seen[NCPU];
 
 // assembly code in kernelvec.S for machine-mode timer interrupt.
 extern void timervec();
@@ -33,6 +36,14 @@ start()
   // disable paging for now.
   w_satp(0);
 
+  // give supervisor mode access to all of physical memory,
+  // including the CLINT, which it uses to send IPIs.
+  w_pmpaddr0(0x3fffffffffffffull);
+  w_pmpcfg0(0xf);
+
+  // let supervisor mode read the cycle and time CSRs.
+  w_mcounteren(r_mcounteren() | 1 | 2);
+
   // delegate all interrupts and exceptions to supervisor mode.
   w_medeleg(0xffff);
   w_mideleg(0xffff);
@@ -49,7 +60,7 @@ start()
   asm volatile("mret");
 }
 
-// set up to receive timer interrupts in machine mode,
+// set up to receive timer interrupts and IPIs in machine mode,
 // which arrive at timervec in kernelvec.S,
 // which turns them into software interrupts for
 // devintr() in trap.c.
@@ -60,16 +71,20 @@ timerinit()
   int id = r_mhartid();
 
   // ask the CLINT for a timer interrupt.
-  int interval = 1000000; // cycles; about 1/10th second in qemu.
+  int interval = TICKCYCLES; // cycles; 1/HZ second in qemu.
   *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + interval;
 
   // prepare information in scratch[] for timervec.
   // scratch[0..2] : space for timervec to save registers.
   // scratch[3] : address of CLINT MTIMECMP register.
   // scratch[4] : desired interval (in cycles) between timer interrupts.
+  // scratch[5] : address of CLINT MSIP register.
+  // scratch[6] : timer interrupts so far, for timerfired().
   uint64 *scratch = &timer_scratch[id][0];
   scratch[3] = CLINT_MTIMECMP(id);
   scratch[4] = interval;
+  scratch[5] = CLINT_MSIP(id);
+  scratch[6] = 0;
   w_mscratch((uint64)scratch);
 
   // set the machine-mode trap handler.
@@ -78,6 +93,24 @@ timerinit()
   // enable machine-mode interrupts.
   w_mstatus(r_mstatus() | MSTATUS_MIE);
 
-  // enable machine-mode timer interrupts.
-  w_mie(r_mie() | MIE_MTIE);
+  // enable machine-mode timer and software interrupts.
+  w_mie(r_mie() | MIE_MTIE | MIE_MSIE);
+}
+
+// has this CPU's timer gone off since the last call?
+// a supervisor software interrupt may be a forwarded
+// timer interrupt, an IPI, or both.
+// interrupts must be disabled.
+int
+timerfired(void)
+{
+  int id = cpuid();
+  uint64 n;
+
+  __sync_synchronize();
+  n = timer_scratch[id][6];
+  if(n == timer_seen[id])
+    return 0;
+  timer_seen[id] = n;
+  return 1;
 }
@@ -104,6 +104,17 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
+extern uint64 sys_memstat(void);
+extern uint64 sys_schedstat(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_nice(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_fcntl(void);
+extern uint64 sys_logstat(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -127,6 +138,17 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_memstat] sys_memstat,
+[SYS_schedstat] sys_schedstat,
+[SYS_setpriority] sys_setpriority,
+[SYS_nice]    sys_nice,
+[SYS_lockstat] sys_lockstat,
+[SYS_fsync]   sys_fsync,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_spawn]   sys_spawn,
+[SYS_fcntl]   sys_fcntl,
+[SYS_logstat] sys_logstat,
 };
 
 void
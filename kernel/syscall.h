@@ -20,3 +20,14 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_memstat 22
+#define SYS_schedstat 23
+#define SYS_setpriority 24
+#define SYS_nice   25
+#define SYS_lockstat 26
+#define SYS_fsync  27
+#define SYS_mmap   28
+#define SYS_munmap 29
+#define SYS_spawn  30
+#define SYS_fcntl  31
+#define SYS_logstat 32
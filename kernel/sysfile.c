@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "logstat.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -75,6 +76,7 @@ sys_read(void)
 
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
     return -1;
+  mmapprefault(p, n, PTE_W);
   return fileread(f, p, n);
 }
 
@@ -87,6 +89,7 @@ sys_write(void)
 
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
     return -1;
+  mmapprefault(p, n, PTE_R);
 
   return filewrite(f, p, n);
 }
@@ -104,6 +107,62 @@ sys_close(void)
   return 0;
 }
 
+// wait until the file system updates made so far are on disk.
+// the log commits everything together, so this flushes more
+// than just fd's file.
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  log_flush();
+  return 0;
+}
+
+// report the log's progress to a user struct logstat.
+uint64
+sys_logstat(void)
+{
+  uint64 addr;
+  struct logstat st;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  logstat(&st);
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// mmap(addr, len, prot, flags, fd, off). addr is only a hint,
+// and is ignored.
+uint64
+sys_mmap(void)
+{
+  struct file *f;
+  uint64 len;
+  int prot, flags, off;
+
+  if(argaddr(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argfd(4, 0, &f) < 0 || argint(5, &off) < 0)
+    return -1;
+  if(off < 0)
+    return -1;
+  return mmap(len, prot, flags, f, off);
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  if(argaddr(0, &addr) < 0 || argaddr(1, &len) < 0)
+    return -1;
+  return munmap(addr, len);
+}
+
 uint64
 sys_fstat(void)
 {
@@ -166,16 +225,18 @@ bad:
 }
 
 // Is the directory dp empty except for "." and ".." ?
+// They needn't be its first two entries; see dirlookup().
 int
 isdirempty(struct inode *dp)
 {
   int off;
   struct dirent de;
 
-  for(off=2*sizeof(de); off<dp->size; off+=sizeof(de)){
+  for(off=0; off<dp->size; off+=sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("isdirempty: readi");
-    if(de.inum != 0)
+    if(de.inum != 0 && namecmp(de.name, ".") != 0 &&
+       namecmp(de.name, "..") != 0)
       return 0;
   }
   return 1;
@@ -185,7 +246,6 @@ uint64
 sys_unlink(void)
 {
   struct inode *ip, *dp;
-  struct dirent de;
   char name[DIRSIZ], path[MAXPATH];
   uint off;
 
@@ -215,9 +275,7 @@ sys_unlink(void)
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  dirunlink(dp, name, off);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -412,19 +470,26 @@ sys_chdir(void)
   return 0;
 }
 
-uint64
-sys_exec(void)
+static void
+freeargv(char **argv)
 {
-  char path[MAXPATH], *argv[MAXARG];
   int i;
-  uint64 uargv, uarg;
 
-  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  for(i = 0; i < MAXARG && argv[i] != 0; i++)
+    kfree(argv[i]);
+}
+
+// Copy the user argument vector at uargv into argv[MAXARG],
+// a page per string.
+static int
+fetchargv(uint64 uargv, char **argv)
+{
+  int i;
+  uint64 uarg;
+
+  memset(argv, 0, MAXARG*sizeof(char*));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
+    if(i >= MAXARG){
       goto bad;
     }
     if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
@@ -440,18 +505,78 @@ sys_exec(void)
     if(fetchstr(uarg, argv[i], PGSIZE) < 0)
       goto bad;
   }
+  return 0;
+
+ bad:
+  freeargv(argv);
+  return -1;
+}
+
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  uint64 uargv;
+
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
+    return -1;
+  }
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
 
   int ret = exec(path, argv);
 
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
+  freeargv(argv);
+  return ret;
+}
+
+// spawn(path, argv, fds): fds is 0, or an array of NSPAWNFD
+// descriptors, -1 for closed, that become the child's 0, 1, 2.
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  struct file *files[NSPAWNFD], **fp = 0;
+  struct proc *p = myproc();
+  int fds[NSPAWNFD], i;
+  uint64 uargv, ufds;
+
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0 ||
+     argaddr(2, &ufds) < 0)
+    return -1;
+  if(ufds){
+    if(copyin(p->pagetable, (char*)fds, ufds, sizeof(fds)) < 0)
+      return -1;
+    for(i = 0; i < NSPAWNFD; i++){
+      if(fds[i] == -1)
+        files[i] = 0;
+      else if(fds[i] < 0 || fds[i] >= NOFILE ||
+              (files[i] = p->ofile[fds[i]]) == 0)
+        return -1;
+    }
+    fp = files;
+  }
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
+
+  int ret = spawn(path, argv, fp);
 
+  freeargv(argv);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+// fcntl(fd, cmd, arg): only pipes have anything to control.
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+    return -1;
+  if(f->type != FD_PIPE)
+    return -1;
+  return pipefcntl(f, cmd, arg);
 }
 
 uint64
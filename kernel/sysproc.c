@@ -6,6 +6,9 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "memstat.h"
+#include "schedstat.h"
+#include "lockstat.h"
 
 uint64
 sys_exit(void)
@@ -95,3 +98,74 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// report physical memory usage to a user struct memstat.
+uint64
+sys_memstat(void)
+{
+  uint64 addr;
+  struct memstat st;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  kmemstat(&st);
+  bstat(&st);
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// copy per-CPU scheduler statistics to a user array
+// of n struct cpustat. returns the number filled in.
+uint64
+sys_schedstat(void)
+{
+  uint64 addr;
+  int n;
+  struct cpustat st[NCPU];
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  n = schedstat(st, n);
+  if(copyout(myproc()->pagetable, addr, (char *)st, n*sizeof(st[0])) < 0)
+    return -1;
+  return n;
+}
+
+uint64
+sys_setpriority(void)
+{
+  int pid, policy, prio;
+
+  if(argint(0, &pid) < 0 || argint(1, &policy) < 0 || argint(2, &prio) < 0)
+    return -1;
+  return setpriority(pid, policy, prio);
+}
+
+uint64
+sys_nice(void)
+{
+  int incr;
+
+  if(argint(0, &incr) < 0)
+    return -1;
+  return nice(incr);
+}
+
+// copy spinlock statistics to a user array of n
+// struct lockstat. returns the number filled in.
+uint64
+sys_lockstat(void)
+{
+  uint64 addr;
+  int i, n;
+  struct lockstat st;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  for(i = 0; i < n && lockstat(i, &st) == 0; i++){
+    if(copyout(myproc()->pagetable, addr + i*sizeof(st), (char *)&st, sizeof(st)) < 0)
+      return -1;
+  }
+  return i;
+}
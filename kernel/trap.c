@@ -67,15 +67,22 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if((r_scause() == 12 || r_scause() == 13 || r_scause() == 15) &&
+            mmapfault(p, r_stval(), r_scause() == 12 ? PTE_X :
+                      r_scause() == 13 ? PTE_R : PTE_W) == 0){
+    // a page of a mapped file
   }
   #ifndef NONE
   else if(p->pid > 2 && (r_scause() == 12 || r_scause() == 13 || r_scause() == 15)){
       printf("pagefault\n");
       uint64 va = r_stval();
-      pte_t* pte = walk(p->pagetable, va, 0);
-      if(PTE_PG & *pte){
+      pte_t* pte = va < MAXVA ? walk(p->pagetable, va, 0) : 0;
+      if(pte && (PTE_PG & *pte)){
         printf("loading page from disk...\n");
         load_disk_page(va);
+      } else {
+        // not paged out, so retrying would fault again.
+        p->killed = 1;
       }
   } 
   #endif 
@@ -91,7 +98,7 @@ usertrap(void)
     exit(-1);
 
   // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  if(which_dev == 2 && needresched())
     yield();
 
   usertrapret();
@@ -165,7 +172,7 @@ kerneltrap()
   }
 
   // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
+  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING && needresched())
     yield();
 
   // the yield() may have caused some traps to occur,
@@ -216,16 +223,22 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer interrupt
+    // or IPI, forwarded by timervec in kernelvec.S.
+
+    // acknowledge the software interrupt by clearing
+    // the SSIP bit in sip. do it before timerfired()
+    // so that a timer interrupt arriving now isn't lost.
+    w_sip(r_sip() & ~2);
+
+    if(!timerfired()){
+      // just an IPI to get this CPU out of wfi.
+      return 1;
+    }
 
     if(cpuid() == 0){
       clockintr();
     }
-    
-    // acknowledge the software interrupt by clearing
-    // the SSIP bit in sip.
-    w_sip(r_sip() & ~2);
 
     return 2;
   } else {
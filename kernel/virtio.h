@@ -45,7 +45,11 @@
 
 // this many virtio descriptors.
 // must be a power of two.
-#define NUM 8
+#define NUM 32
+
+// most blocks in one request; each takes a descriptor,
+// plus two for the header and status.
+#define NSEG 8
 
 // a single descriptor, from the spec.
 struct virtq_desc {
@@ -184,12 +184,12 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
+// a disk transfer of k blocks uses k+2 descriptors.
 static int
-alloc3_desc(int *idx)
+alloc_descs(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -200,27 +200,32 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// queue one request to read or write the n bufs in b[],
+// which must be for consecutive blocks, without waiting
+// for it to finish. caller must hold vdisk_lock.
+static void
+submit(struct buf **b, int n, int write)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  uint64 sector = b[0]->blockno * (BSIZE / 512);
 
-  acquire(&disk.vdisk_lock);
+  if(n < 1 || n > NSEG)
+    panic("virtio submit");
 
   // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
+  // one descriptor for type/reserved/sector, then descriptors
+  // for the data, then one for a 1-byte status result. the data
+  // may be split over as many descriptors as we like; we use
+  // one per buf.
 
-  // allocate the three descriptors.
-  int idx[3];
+  int idx[NSEG+2];
   while(1){
-    if(alloc3_desc(idx) == 0) {
+    if(alloc_descs(idx, n+2) == 0) {
       break;
     }
     sleep(&disk.free[0], &disk.vdisk_lock);
   }
 
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
   struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
@@ -237,24 +242,30 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  for(int i = 0; i < n; i++){
+    if(i > 0 && (b[i]->dev != b[0]->dev || b[i]->blockno != b[0]->blockno + i))
+      panic("virtio submit: not consecutive");
+    disk.desc[idx[i+1]].addr = (uint64) b[i]->data;
+    disk.desc[idx[i+1]].len = BSIZE;
+    if(write)
+      disk.desc[idx[i+1]].flags = 0; // device reads b->data
+    else
+      disk.desc[idx[i+1]].flags = VRING_DESC_F_WRITE; // device writes b->data
+    disk.desc[idx[i+1]].flags |= VRING_DESC_F_NEXT;
+    disk.desc[idx[i+1]].next = idx[i+2];
+
+    // record the bufs for virtio_disk_intr().
+    b[i]->disk = 1;
+    b[i]->qnext = i+1 < n ? b[i+1] : 0;
+  }
 
   disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  disk.desc[idx[n+1]].addr = (uint64) &disk.info[idx[0]].status;
+  disk.desc[idx[n+1]].len = 1;
+  disk.desc[idx[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[idx[n+1]].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  disk.info[idx[0]].b = b[0];
 
   // tell the device the first index in our chain of descriptors.
   disk.avail->ring[disk.avail->idx % NUM] = idx[0];
@@ -267,15 +278,51 @@ virtio_disk_rw(struct buf *b, int write)
   __sync_synchronize();
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+}
+
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  acquire(&disk.vdisk_lock);
+  submit(&b, 1, write);
 
   // Wait for virtio_disk_intr() to say request has finished.
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+  release(&disk.vdisk_lock);
+}
+
+// start reading or writing the n bufs in b[] and return
+// without waiting. runs of bufs for consecutive blocks go
+// to the device as single requests of up to NSEG blocks.
+// each b->disk stays 1 until its request finishes; the caller
+// may brelse(b) before then, since bget() won't recycle b
+// and bread() waits for it.
+void
+virtio_disk_start(struct buf **b, int n, int write)
+{
+  int i, j;
+
+  acquire(&disk.vdisk_lock);
+  for(i = 0; i < n; i = j){
+    for(j = i+1; j < n && j-i < NSEG; j++)
+      if(b[j]->dev != b[i]->dev || b[j]->blockno != b[j-1]->blockno + 1)
+        break;
+    submit(b+i, j-i, write);
+  }
+  release(&disk.vdisk_lock);
+}
 
+// wait for a request started by virtio_disk_start() to finish.
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
+  while(b->disk == 1) {
+    sleep(b, &disk.vdisk_lock);
+  }
   release(&disk.vdisk_lock);
 }
 
@@ -305,8 +352,14 @@ virtio_disk_intr()
       panic("virtio_disk_intr status");
 
     struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    disk.info[id].b = 0;
+    free_chain(id);
+    while(b){
+      struct buf *next = b->qnext;
+      b->disk = 0;   // disk is done with buf
+      wakeup(b);
+      b = next;
+    }
 
     disk.used_idx += 1;
   }
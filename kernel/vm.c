@@ -7,6 +7,7 @@
 #include "fs.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "memstat.h"
 
 /*
  * the kernel's page table.
@@ -23,7 +24,7 @@ kvmmake(void)
 {
   pagetable_t kpgtbl;
 
-  kpgtbl = (pagetable_t) kalloc();
+  kpgtbl = (pagetable_t) kalloctype(KMEM_PGTBL);
   memset(kpgtbl, 0, PGSIZE);
 
   // uart registers
@@ -35,6 +36,9 @@ kvmmake(void)
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
+  // CLINT, for sending inter-processor interrupts.
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // map kernel text executable and read-only.
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
@@ -205,7 +209,7 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
     if(*pte & PTE_V) {
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kalloctype(KMEM_PGTBL)) == 0)
         return 0;
       memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
@@ -215,10 +219,11 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
 }
 
 // Look up a virtual address, return the physical address,
-// or 0 if not mapped.
+// or 0 if not mapped, or if the mapping lacks any of the
+// permissions in perm.
 // Can only be used to look up user pages.
-uint64
-walkaddr(pagetable_t pagetable, uint64 va)
+static uint64
+walkperm(pagetable_t pagetable, uint64 va, int perm)
 {
   pte_t *pte;
   uint64 pa;
@@ -239,13 +244,40 @@ walkaddr(pagetable_t pagetable, uint64 va)
     return 0;
   }
   #endif
-  if((*pte & PTE_U) == 0){
+  if((*pte & PTE_U) == 0 || (*pte & perm) != perm){
     return 0;
   }
   pa = PTE2PA(*pte);
   return pa;
 }
 
+uint64
+walkaddr(pagetable_t pagetable, uint64 va)
+{
+  return walkperm(pagetable, va, 0);
+}
+
+// Like walkperm(), for a copy to or from the current process,
+// but first fault in va if it's in a mapped file or a
+// program's text and isn't mapped for perm yet. Faults may
+// sleep and lock the file's inode, so only take them when no
+// spin lock and no inode lock is held; read() and write(),
+// which copy with an inode locked, rely on mmapprefault().
+static uint64
+copyaddr(pagetable_t pagetable, uint64 va, int perm)
+{
+  struct proc *p = myproc();
+  uint64 pa;
+
+  if((pa = walkperm(pagetable, va, perm)) != 0)
+    return pa;
+  if(p == 0 || pagetable != p->pagetable || !intr_get() || p->nilock > 0)
+    return 0;
+  if(mmapfault(p, va, perm == PTE_W ? PTE_W : PTE_R) < 0)
+    return 0;
+  return walkperm(pagetable, va, perm);
+}
+
 // add a mapping to the kernel page table.
 // only used when booting.
 // does not flush TLB or enable paging.
@@ -283,8 +315,9 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
-// Optionally free the physical memory.
+// page-aligned. The mappings must exist, or be reserved by
+// uvmlazy(). Optionally free the physical memory; page cache
+// pages are handed back to the cache instead.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
@@ -297,6 +330,10 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
     if((pte = walk(pagetable, a, 0)) == 0)
       panic("uvmunmap: walk");
+    if((*pte & (PTE_V|PTE_CACHE)) == PTE_CACHE){
+      *pte = 0;  // reserved, never faulted in
+      continue;
+    }
     #ifndef NONE
     if(((*pte & PTE_V) == 0) && ((*pte & PTE_PG) == 0))
       panic("uvmunmap: not mapped");
@@ -309,6 +346,12 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
 
+    if(*pte & PTE_CACHE){
+      pcacheput(PTE2PA(*pte));
+      *pte = 0;
+      continue;
+    }
+
     #ifndef NONE
     if(do_free && ((*pte & PTE_PG) == 0)){
       uint64 pa = PTE2PA(*pte);
@@ -344,7 +387,7 @@ pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kalloctype(KMEM_PGTBL);
   if(pagetable == 0)
     return 0;
   memset(pagetable, 0, PGSIZE);
@@ -361,7 +404,7 @@ uvminit(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
+  mem = kalloctype(KMEM_USER);
   memset(mem, 0, PGSIZE);
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
@@ -383,7 +426,8 @@ swapout(pagetable_t pagetable, uint64 a){
   release(&p->lock);
   pte_t* pte_to_take_from = walk(pg_to_save->pagetable, pg_to_save->va, 0);
   uint64 pa = PTE2PA(*pte_to_take_from);
-  writeToSwapFile(p, (char *)pa, swap_index*PGSIZE, PGSIZE);
+  if(writeToSwapFile(p, (char *)pa, swap_index*PGSIZE, PGSIZE) < 0)
+    panic("failed to write to swap file.");
   acquire(&p->lock);
   kfree((void*)pa);
   
@@ -423,7 +467,7 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloctype(KMEM_USER);
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
@@ -485,6 +529,31 @@ uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
   return newsz;
 }
 
+// Reserve the pages from oldsz to newsz, which need not be page
+// aligned, to be mapped when first touched, like the program
+// text that exec() leaves to mmapfault(). Their PTEs hold just
+// PTE_CACHE, without PTE_V, which tells uvmunmap() and
+// uvmcopy() the page may be missing. Returns newsz, or 0 if a
+// page-table page can't be allocated.
+uint64
+uvmlazy(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
+{
+  uint64 a;
+  pte_t *pte;
+
+  if(newsz < oldsz)
+    return oldsz;
+
+  for(a = PGROUNDUP(oldsz); a < newsz; a += PGSIZE){
+    if((pte = walk(pagetable, a, 1)) == 0)
+      return 0;
+    if(*pte & PTE_V)
+      panic("uvmlazy: remap");
+    *pte = PTE_CACHE;
+  }
+  return newsz;
+}
+
 
 // it just swoops
 // and tidy up!
@@ -524,7 +593,7 @@ swp_in(uint64 round_va, void* pyscpg, struct page* free_pg){
 void
 load_disk_page(uint64 va){
   uint64 round_va = PGROUNDDOWN(va);
-  void* pyscpg = kalloc();
+  void* pyscpg = kalloctype(KMEM_USER);
   struct proc* p = myproc();
   acquire(&p->lock);
 
@@ -551,7 +620,8 @@ load_disk_page(uint64 va){
     pte_t* pte_to_take_from = walk(pg_to_swap->pagetable, pg_to_swap->va, 0);
     uint64 pa = PTE2PA(*pte_to_take_from);
     release(&p->lock);
-    writeToSwapFile(p, (char *)pa, swap_index*PGSIZE, PGSIZE);
+    if(writeToSwapFile(p, (char *)pa, swap_index*PGSIZE, PGSIZE) < 0)
+      panic("failed to write to swap file.");
     acquire(&p->lock);
     kfree((void*)pa);
     p->swapped_pages[swap_index] = *pg_to_swap;
@@ -599,7 +669,9 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 // Given a parent process's page table, copy
 // its memory into a child's page table.
 // Copies both the page table and the
-// physical memory.
+// physical memory. Page cache pages, and pages reserved by
+// uvmlazy(), are only reserved in the child; mmapcopy()
+// shares the cache pages.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
@@ -613,6 +685,11 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walk(old, i, 0)) == 0)
       panic("uvmcopy: pte should exist");
+    if(*pte & PTE_CACHE){
+      if(uvmlazy(new, i, i + PGSIZE) == 0)
+        goto err;
+      continue;
+    }
     #ifndef NONE
     if((*pte & PTE_V ) == 0 && ((*pte & PTE_PG) == 0))
       panic("uvmcopy: page not present");
@@ -627,7 +704,7 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if((mem = kalloctype(KMEM_USER)) == 0)
       goto err;
     memmove(mem, (char*)pa, PGSIZE);
     if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
@@ -665,7 +742,7 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = copyaddr(pagetable, va0, PTE_W);  // not read-only mapped file pages
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (dstva - va0);
@@ -690,7 +767,7 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = copyaddr(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -717,7 +794,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = copyaddr(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -22,7 +22,7 @@
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog;     // Number of log blocks, header included
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -40,6 +40,8 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void rootlink(char *name, uint inum);
+void rootwrite(uint rootino);
 
 // convert to intel byte order
 ushort
@@ -68,10 +70,8 @@ int
 main(int argc, char *argv[])
 {
   int i, cc, fd;
-  uint rootino, inum, off;
-  struct dirent de;
+  uint rootino, inum;
   char buf[BSIZE];
-  struct dinode din;
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
@@ -90,6 +90,15 @@ main(int argc, char *argv[])
     exit(1);
   }
 
+  // the log gets about 1/16 of the disk: room for at least
+  // three maximal FS calls, and no more than a header block
+  // can describe.
+  nlog = FSSIZE / 16 + 1;
+  if(nlog < MAXOPBLOCKS*3 + 1)
+    nlog = MAXOPBLOCKS*3 + 1;
+  if(nlog > LOGSIZE + 1)
+    nlog = LOGSIZE + 1;
+
   // 1 fs block = 1 disk sector
   nmeta = 2 + nlog + ninodeblocks + nbitmap;
   nblocks = FSSIZE - nmeta;
@@ -118,15 +127,8 @@ main(int argc, char *argv[])
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
 
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
-
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
+  rootlink(".", rootino);
+  rootlink("..", rootino);
 
   for(i = 2; i < argc; i++){
     // get rid of "user/"
@@ -152,10 +154,7 @@ main(int argc, char *argv[])
 
     inum = ialloc(T_FILE);
 
-    bzero(&de, sizeof(de));
-    de.inum = xshort(inum);
-    strncpy(de.name, shortname, DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    rootlink(shortname, inum);
 
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
@@ -163,12 +162,7 @@ main(int argc, char *argv[])
     close(fd);
   }
 
-  // fix size of root inode dir
-  rinode(rootino, &din);
-  off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
-  din.size = xint(off);
-  winode(rootino, &din);
+  rootwrite(rootino);
 
   balloc(freeblock);
 
@@ -258,13 +252,71 @@ balloc(int used)
   wsect(sb.bmapstart, buf);
 }
 
+// The root directory is hashed; see dirlookup() in kernel/fs.c.
+// It's built in memory, bucket chains and all, and written once
+// every file is in it.
+#define NROOTBLK 64
+
+struct dirent rootdir[NROOTBLK][DPB];
+uint rootnext[NROOTBLK];   // next block of each block's chain
+uint nrootblk = NDIRBUCKET;
+
+// must match dirhash() in kernel/fs.c.
+uint
+dirhash(char *name)
+{
+  uint h = 0;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return h;
+}
+
+void
+rootlink(char *name, uint inum)
+{
+  uint b, i;
+
+  for(b = dirhash(name) % NDIRBUCKET; ; b = rootnext[b]){
+    for(i = 0; i < DPB-1; i++){
+      if(rootdir[b][i].inum == 0){
+        rootdir[b][i].inum = xshort(inum);
+        strncpy(rootdir[b][i].name, name, DIRSIZ);
+        return;
+      }
+    }
+    if(rootnext[b] == 0){
+      assert(nrootblk < NROOTBLK);
+      rootnext[b] = nrootblk++;
+    }
+  }
+}
+
+void
+rootwrite(uint rootino)
+{
+  struct dirtail *t;
+  uint b;
+
+  static_assert(sizeof(struct dirtail) == sizeof(struct dirent), "bad dirtail");
+  for(b = 0; b < nrootblk; b++){
+    t = (struct dirtail*)&rootdir[b][DPB-1];
+    t->magic[0] = DIRMAGIC0;
+    t->magic[1] = DIRMAGIC1;
+    t->nbucket = xint(NDIRBUCKET);
+    t->next = xint(rootnext[b]);
+    iappend(rootino, rootdir[b], BSIZE);
+  }
+}
+
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
 void
 iappend(uint inum, void *xp, int n)
 {
   char *p = (char*)xp;
-  uint fbn, off, n1;
+  uint fbn, fbn2, off, n1;
   struct dinode din;
   char buf[BSIZE];
   uint indirect[NINDIRECT];
@@ -281,7 +333,7 @@ iappend(uint inum, void *xp, int n)
         din.addrs[fbn] = xint(freeblock++);
       }
       x = xint(din.addrs[fbn]);
-    } else {
+    } else if(fbn < NDIRECT + NINDIRECT){
       if(xint(din.addrs[NDIRECT]) == 0){
         din.addrs[NDIRECT] = xint(freeblock++);
       }
@@ -291,6 +343,23 @@ iappend(uint inum, void *xp, int n)
         wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
       }
       x = xint(indirect[fbn-NDIRECT]);
+    } else {
+      fbn2 = fbn - NDIRECT - NINDIRECT;
+      if(xint(din.addrs[NDIRECT+1]) == 0){
+        din.addrs[NDIRECT+1] = xint(freeblock++);
+      }
+      rsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      if(indirect[fbn2 / NINDIRECT] == 0){
+        indirect[fbn2 / NINDIRECT] = xint(freeblock++);
+        wsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      }
+      x = xint(indirect[fbn2 / NINDIRECT]);
+      rsect(x, (char*)indirect);
+      if(indirect[fbn2 % NINDIRECT] == 0){
+        indirect[fbn2 % NINDIRECT] = xint(freeblock++);
+        wsect(x, (char*)indirect);
+      }
+      x = xint(indirect[fbn2 % NINDIRECT]);
     }
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
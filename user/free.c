@@ -0,0 +1,47 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/memstat.h"
+#include "user/user.h"
+
+// report physical memory usage, in pages and kilobytes.
+
+char *typenames[] = {
+[KMEM_OTHER]      "other",
+[KMEM_USER]       "user",
+[KMEM_PGTBL]      "pagetable",
+[KMEM_KSTACK]     "kstack",
+[KMEM_TRAPFRAME]  "trapframe",
+[KMEM_PIPE]       "pipe",
+[KMEM_BUF]        "bcache",
+[KMEM_INODE]      "icache",
+[KMEM_PCACHE]     "pcache",
+};
+
+void
+line(char *name, uint64 pages)
+{
+  printf("%s\t%l pages\t%l KB\n", name, pages, pages * 4);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct memstat st;
+  int i;
+
+  if(memstat(&st) < 0){
+    fprintf(2, "free: memstat failed\n");
+    exit(1);
+  }
+
+  line("total", st.total);
+  line("free", st.free);
+  line("used", st.total - st.free);
+  line("peak", st.peak);
+  for(i = KMEM_OTHER; i < KMEM_NTYPE; i++)
+    line(typenames[i], st.used[i]);
+  printf("kalloc\t%l calls\t%l failed\n", st.nalloc, st.nfail);
+  printf("bcache\t%l bufs\t%l in use\t%l pinned\n",
+         st.nbuf, st.bufinuse, st.bufpinned);
+  exit(0);
+}
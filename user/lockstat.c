@@ -0,0 +1,40 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+// report spinlock contention, most spinning first.
+
+#define NSTAT 32
+
+struct lockstat st[NSTAT];
+
+int
+main(int argc, char *argv[])
+{
+  struct lockstat t;
+  int i, j, n;
+
+  if((n = lockstat(st, NSTAT)) < 0){
+    fprintf(2, "lockstat: lockstat failed\n");
+    exit(1);
+  }
+
+  // insertion sort by spins.
+  for(i = 1; i < n; i++){
+    t = st[i];
+    for(j = i; j > 0 && st[j-1].nspin < t.nspin; j--)
+      st[j] = st[j-1];
+    st[j] = t;
+  }
+
+  printf("name\t\tlocks\tacquire\tcontend\tspins\tavghold\tmaxhold\n");
+  for(i = 0; i < n; i++){
+    printf("%s\t%s%l\t%l\t%l\t%l\t%l\t%l\n", st[i].name,
+           strlen(st[i].name) < 8 ? "\t" : "", st[i].nlock,
+           st[i].nacquire, st[i].ncontend, st[i].nspin,
+           st[i].nacquire ? st[i].holdtime / st[i].nacquire : 0,
+           st[i].maxhold);
+  }
+  exit(0);
+}
@@ -0,0 +1,22 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// run a command with its nice value raised by n.
+// a negative n asks for more of the CPU.
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  if(argc < 3){
+    fprintf(2, "usage: nice n command [args...]\n");
+    exit(1);
+  }
+  n = argv[1][0] == '-' ? -atoi(argv[1] + 1) : atoi(argv[1]);
+  nice(n);
+  exec(argv[2], argv + 2);
+  fprintf(2, "nice: exec %s failed\n", argv[2]);
+  exit(1);
+}
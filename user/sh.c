@@ -1,6 +1,7 @@
 // Shell.
 
 #include "kernel/types.h"
+#include "kernel/param.h"
 #include "user/user.h"
 #include "kernel/fcntl.h"
 
@@ -52,12 +53,80 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void freecmd(struct cmd*);
+void runcmd(struct cmd*, int*);
 
-// Execute cmd.  Never returns.
+// Processes started by runcmd() that the shell waits for.
+#define MAXPIDS 16
+int pids[MAXPIDS];
+int npids;
+
+// Wait for the processes in pids[]. Background processes
+// that exit meanwhile are reaped too.
+void
+waitcmds(void)
+{
+  int i, pid;
+
+  while(npids > 0 && (pid = wait(0)) >= 0){
+    for(i = 0; i < npids; i++){
+      if(pids[i] == pid){
+        pids[i] = pids[--npids];
+        break;
+      }
+    }
+  }
+  npids = 0;
+}
+
+// Does cmd run as a single program, which spawn() can start?
+int
+simplecmd(struct cmd *cmd)
+{
+  while(cmd->type == REDIR)
+    cmd = ((struct redircmd*)cmd)->cmd;
+  return cmd->type == EXEC;
+}
+
+// Start cmd, which runs alongside the shell: a pipeline stage,
+// or a background command. A simple command is spawned; any
+// other runs in a subshell, with fd[] as its 0, 1 and 2.
+void
+subcmd(struct cmd *cmd, int *fd)
+{
+  int i, pid;
+  int std[3] = { 0, 1, 2 };
+
+  if(simplecmd(cmd)){
+    runcmd(cmd, fd);
+    return;
+  }
+  if((pid = fork1()) == 0){
+    for(i = 0; i < 3; i++){
+      if(fd[i] != i){
+        close(i);
+        dup(fd[i]);
+      }
+    }
+    // don't hold pipes open for the subshell's readers.
+    for(i = 3; i < NOFILE; i++)
+      close(i);
+    npids = 0;
+    runcmd(cmd, std);
+    waitcmds();
+    exit(0);
+  }
+  if(npids < MAXPIDS)
+    pids[npids++] = pid;
+}
+
+// Start cmd with fd[i] as its file descriptor i, for i < 3.
+// Returns without waiting for what it started, except where
+// cmd is a list; the pids to wait for go in pids[].
 void
-runcmd(struct cmd *cmd)
+runcmd(struct cmd *cmd, int *fd)
 {
-  int p[2];
+  int p[2], nfd[3], f, pid, n;
   struct backcmd *bcmd;
   struct execcmd *ecmd;
   struct listcmd *lcmd;
@@ -65,7 +134,7 @@ runcmd(struct cmd *cmd)
   struct redircmd *rcmd;
 
   if(cmd == 0)
-    exit(1);
+    return;
 
   switch(cmd->type){
   default:
@@ -74,60 +143,55 @@ runcmd(struct cmd *cmd)
   case EXEC:
     ecmd = (struct execcmd*)cmd;
     if(ecmd->argv[0] == 0)
-      exit(1);
-    exec(ecmd->argv[0], ecmd->argv);
-    fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+      return;
+    if((pid = spawn(ecmd->argv[0], ecmd->argv, fd)) < 0){
+      fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+      return;
+    }
+    if(npids < MAXPIDS)
+      pids[npids++] = pid;
     break;
 
   case REDIR:
     rcmd = (struct redircmd*)cmd;
-    close(rcmd->fd);
-    if(open(rcmd->file, rcmd->mode) < 0){
+    if((f = open(rcmd->file, rcmd->mode)) < 0){
       fprintf(2, "open %s failed\n", rcmd->file);
-      exit(1);
+      return;
     }
-    runcmd(rcmd->cmd);
+    memmove(nfd, fd, sizeof(nfd));
+    nfd[rcmd->fd] = f;
+    runcmd(rcmd->cmd, nfd);
+    close(f);
     break;
 
   case LIST:
     lcmd = (struct listcmd*)cmd;
-    if(fork1() == 0)
-      runcmd(lcmd->left);
-    wait(0);
-    runcmd(lcmd->right);
+    runcmd(lcmd->left, fd);
+    waitcmds();
+    runcmd(lcmd->right, fd);
     break;
 
   case PIPE:
     pcmd = (struct pipecmd*)cmd;
     if(pipe(p) < 0)
       panic("pipe");
-    if(fork1() == 0){
-      close(1);
-      dup(p[1]);
-      close(p[0]);
-      close(p[1]);
-      runcmd(pcmd->left);
-    }
-    if(fork1() == 0){
-      close(0);
-      dup(p[0]);
-      close(p[0]);
-      close(p[1]);
-      runcmd(pcmd->right);
-    }
+    memmove(nfd, fd, sizeof(nfd));
+    nfd[1] = p[1];
+    subcmd(pcmd->left, nfd);
+    memmove(nfd, fd, sizeof(nfd));
+    nfd[0] = p[0];
+    subcmd(pcmd->right, nfd);
     close(p[0]);
     close(p[1]);
-    wait(0);
-    wait(0);
     break;
 
   case BACK:
     bcmd = (struct backcmd*)cmd;
-    if(fork1() == 0)
-      runcmd(bcmd->cmd);
+    n = npids;
+    subcmd(bcmd->cmd, fd);
+    npids = n;  // don't wait for it
     break;
   }
-  exit(0);
 }
 
 int
@@ -146,6 +210,8 @@ main(void)
 {
   static char buf[100];
   int fd;
+  int std[3] = { 0, 1, 2 };
+  struct cmd *cmd;
 
   // Ensure that three file descriptors are open.
   while((fd = open("console", O_RDWR)) >= 0){
@@ -155,7 +221,8 @@ main(void)
     }
   }
 
-  // Read and run input commands.
+  // Read and run input commands. Commands are started with
+  // spawn(), so the shell doesn't fork itself for each one.
   while(getcmd(buf, sizeof(buf)) >= 0){
     if(buf[0] == 'c' && buf[1] == 'd' && buf[2] == ' '){
       // Chdir must be called by the parent, not the child.
@@ -164,9 +231,11 @@ main(void)
         fprintf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait(0);
+    if((cmd = parsecmd(buf)) == 0)
+      continue;
+    runcmd(cmd, std);
+    waitcmds();
+    freecmd(cmd);
   }
   exit(0);
 }
@@ -324,18 +393,34 @@ struct cmd *parsepipe(char**, char*);
 struct cmd *parseexec(char**, char*);
 struct cmd *nulterminate(struct cmd*);
 
+// The parser runs in the shell itself, so a syntax error
+// must not exit; it's noted here, and parsecmd() fails.
+int syntaxerr;
+
+void
+syntax(char *s)
+{
+  fprintf(2, "%s\n", s);
+  syntaxerr = 1;
+}
+
 struct cmd*
 parsecmd(char *s)
 {
   char *es;
   struct cmd *cmd;
 
+  syntaxerr = 0;
   es = s + strlen(s);
   cmd = parseline(&s, es);
   peek(&s, es, "");
-  if(s != es){
+  if(s != es && !syntaxerr){
     fprintf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    syntax("syntax");
+  }
+  if(syntaxerr){
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -379,8 +464,10 @@ parseredirs(struct cmd *cmd, char **ps, char *es)
 
   while(peek(ps, es, "<>")){
     tok = gettoken(ps, es, 0, 0);
-    if(gettoken(ps, es, &q, &eq) != 'a')
-      panic("missing file for redirection");
+    if(gettoken(ps, es, &q, &eq) != 'a'){
+      syntax("missing file for redirection");
+      break;
+    }
     switch(tok){
     case '<':
       cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -405,8 +492,10 @@ parseblock(char **ps, char *es)
     panic("parseblock");
   gettoken(ps, es, 0, 0);
   cmd = parseline(ps, es);
-  if(!peek(ps, es, ")"))
-    panic("syntax - missing )");
+  if(!peek(ps, es, ")")){
+    syntax("syntax - missing )");
+    return cmd;
+  }
   gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
@@ -431,13 +520,17 @@ parseexec(char **ps, char *es)
   while(!peek(ps, es, "|)&;")){
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
-    if(tok != 'a')
-      panic("syntax");
+    if(tok != 'a'){
+      syntax("syntax");
+      break;
+    }
+    if(argc + 1 >= MAXARGS){
+      syntax("too many args");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if(argc >= MAXARGS)
-      panic("too many args");
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
@@ -491,3 +584,31 @@ nulterminate(struct cmd *cmd)
   }
   return cmd;
 }
+
+void
+freecmd(struct cmd *cmd)
+{
+  if(cmd == 0)
+    return;
+
+  switch(cmd->type){
+  case REDIR:
+    freecmd(((struct redircmd*)cmd)->cmd);
+    break;
+
+  case PIPE:
+    freecmd(((struct pipecmd*)cmd)->left);
+    freecmd(((struct pipecmd*)cmd)->right);
+    break;
+
+  case LIST:
+    freecmd(((struct listcmd*)cmd)->left);
+    freecmd(((struct listcmd*)cmd)->right);
+    break;
+
+  case BACK:
+    freecmd(((struct backcmd*)cmd)->cmd);
+    break;
+  }
+  free(cmd);
+}
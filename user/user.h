@@ -1,5 +1,9 @@
 struct stat;
 struct rtcdate;
+struct memstat;
+struct cpustat;
+struct lockstat;
+struct logstat;
 
 // system calls
 int fork(void);
@@ -23,6 +27,17 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int memstat(struct memstat*);
+int schedstat(struct cpustat*, int);
+int setpriority(int, int, int);
+int nice(int);
+int lockstat(struct lockstat*, int);
+int fsync(int);
+void *mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int spawn(char*, char**, int*);
+int fcntl(int, int, int);
+int logstat(struct logstat*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -7,6 +7,10 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/memstat.h"
+#include "kernel/lockstat.h"
+#include "kernel/schedstat.h"
+#include "kernel/logstat.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -528,6 +532,369 @@ opentest(char *s)
   }
 }
 
+// fsync() should not return until the transaction holding
+// a freshly written file's blocks is on disk, and should
+// reject a bad fd.
+void
+fsynctest(char *s)
+{
+  int fd, target;
+  char buf[BSIZE];
+  struct logstat st;
+
+  fd = open("fsyncf", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create fsyncf failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'f', sizeof(buf));
+  for(int i = 0; i < 4; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write fsyncf failed\n", s);
+      exit(1);
+    }
+    // the write is in the open transaction, or an older one.
+    if(logstat(&st) < 0){
+      printf("%s: logstat failed\n", s);
+      exit(1);
+    }
+    target = st.nblock > 0 ? st.seq + 1 : st.seq;
+    if(fsync(fd) != 0){
+      printf("%s: fsync failed\n", s);
+      exit(1);
+    }
+    if(logstat(&st) < 0 || st.done < target){
+      printf("%s: fsync returned before transaction %d was on disk\n", s, target - 1);
+      exit(1);
+    }
+    if(st.outstanding == 0 && st.reserved != 0){
+      printf("%s: %d log blocks reserved with no op running\n", s, st.reserved);
+      exit(1);
+    }
+  }
+  close(fd);
+  if(fsync(fd) >= 0){
+    printf("%s: fsync of closed fd succeeded\n", s);
+    exit(1);
+  }
+  unlink("fsyncf");
+}
+
+// directory lookups see creates and unlinks, and a directory's
+// cached entries don't outlive it.
+void
+dcachetest(char *s)
+{
+  struct stat st1, st2;
+  int fd, i;
+
+  for(i = 0; i < 2; i++){
+    if(open("dcd/x", O_RDONLY) >= 0){
+      printf("%s: open of missing dcd/x succeeded\n", s);
+      exit(1);
+    }
+  }
+  if(mkdir("dcd") != 0 || mkdir("dcd/sub") != 0){
+    printf("%s: mkdir dcd failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 2; i++){
+    fd = open("dcd/x", O_CREATE|O_RDWR);
+    if(fd < 0){
+      printf("%s: create dcd/x failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    if(unlink("dcd/x") != 0){
+      printf("%s: unlink dcd/x failed\n", s);
+      exit(1);
+    }
+    if(open("dcd/x", O_RDONLY) >= 0){
+      printf("%s: open of unlinked dcd/x succeeded\n", s);
+      exit(1);
+    }
+  }
+  if(stat("dcd/sub/..", &st1) != 0 || stat("dcd", &st2) != 0 ||
+     st1.ino != st2.ino){
+    printf("%s: dcd/sub/.. isn't dcd\n", s);
+    exit(1);
+  }
+
+  // new directories will likely get the freed inode numbers.
+  if(unlink("dcd/sub") != 0 || unlink("dcd") != 0){
+    printf("%s: unlink dcd failed\n", s);
+    exit(1);
+  }
+  if(mkdir("dcp") != 0 || mkdir("dcp/a") != 0 || mkdir("dcp/a/b") != 0){
+    printf("%s: mkdir dcp failed\n", s);
+    exit(1);
+  }
+  if(stat("dcp/a/..", &st1) != 0 || stat("dcp", &st2) != 0 ||
+     st1.ino != st2.ino ||
+     stat("dcp/a/b/..", &st1) != 0 || stat("dcp/a", &st2) != 0 ||
+     st1.ino != st2.ino){
+    printf("%s: stale .. in a new directory\n", s);
+    exit(1);
+  }
+  unlink("dcp/a/b");
+  unlink("dcp/a");
+  unlink("dcp");
+}
+
+// mmap() a file: private and shared mappings, write-back,
+// read() into a mapping, fork, and munmap.
+void
+mmaptest(char *s)
+{
+  enum { SZ = 2*4096 + 1000 };
+  char buf[100];
+  char *p, *q;
+  int fd, i, pid, xstatus;
+
+  fd = open("mmapf", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create mmapf failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++){
+    buf[0] = 'a' + i % 26;
+    if(write(fd, buf, 1) != 1){
+      printf("%s: write mmapf failed\n", s);
+      exit(1);
+    }
+  }
+
+  // private: stores aren't seen by the file.
+  p = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1){
+    printf("%s: mmap private failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++){
+    if(p[i] != 'a' + i % 26){
+      printf("%s: wrong byte %d in mapping\n", s, i);
+      exit(1);
+    }
+  }
+  if(p[SZ] != 0){
+    printf("%s: bytes past end of file not zero\n", s);
+    exit(1);
+  }
+  p[0] = 'Z';
+  if(munmap(p, SZ) != 0){
+    printf("%s: munmap private failed\n", s);
+    exit(1);
+  }
+
+  // shared: stores are written back by munmap().
+  p = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  q = mmap(0, SZ, PROT_READ, MAP_SHARED, fd, 0);
+  if(p == (char*)-1 || q == (char*)-1 || p == q){
+    printf("%s: mmap shared failed\n", s);
+    exit(1);
+  }
+  if(q[0] != 'a'){
+    printf("%s: private store reached the file\n", s);
+    exit(1);
+  }
+  p[1] = 'Y';
+  if(q[1] != 'Y'){
+    printf("%s: shared mappings don't share\n", s);
+    exit(1);
+  }
+
+  // read() into a mapping, and a child sees the mapping too.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(q[1] != 'Y')
+      exit(1);
+    q[0] = 'X';  // read-only: must kill the child
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: store to a read-only mapping wasn't fatal\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("mmapf", O_RDONLY);
+  if(read(fd, p + 4096, 10) != 10 || p[4096] != 'a' || q[4096] != 'a'){
+    printf("%s: read into a mapping failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // lengths that round up past the end of the address space.
+  fd = open("mmapf", O_RDONLY);
+  if(mmap(0, -1, PROT_READ, MAP_SHARED, fd, 0) != (char*)-1 || munmap(p, -1) != -1){
+    printf("%s: accepted a length of -1\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(munmap(p, SZ) != 0 || munmap(q, 4096) != 0 || munmap(q + 4096, SZ - 4096) != 0){
+    printf("%s: munmap shared failed\n", s);
+    exit(1);
+  }
+  fd = open("mmapf", O_RDONLY);
+  if(read(fd, buf, 2) != 2 || buf[0] != 'a' || buf[1] != 'Y'){
+    printf("%s: shared store wasn't written back\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmapf");
+}
+
+// a program's text is shared with other processes running it,
+// so it must be read-only.
+void
+textwrite(char *s)
+{
+  int pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    volatile int *addr = (int *) textwrite;
+    *addr = 10;
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: write to text succeeded\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// spawn() gives the child only the descriptors it's asked to,
+// and fails, leaving no child behind, if exec() would.
+void
+spawntest(char *s)
+{
+  char *args[] = { "echo", "spawned", 0 };
+  char buf[32];
+  int p[2], fds[3], pid, xstatus, n, tot;
+
+  if(spawn("nosuchprogram", args, 0) != -1){
+    printf("%s: spawn of a missing program succeeded\n", s);
+    exit(1);
+  }
+  if(wait(0) != -1){
+    printf("%s: failed spawn left a child\n", s);
+    exit(1);
+  }
+
+  if(pipe(p) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  fds[0] = -1;
+  fds[1] = p[1];
+  fds[2] = 2;
+  if((pid = spawn("echo", args, fds)) < 0){
+    printf("%s: spawn echo failed\n", s);
+    exit(1);
+  }
+  close(p[1]);
+  tot = 0;
+  while((n = read(p[0], buf + tot, sizeof(buf) - 1 - tot)) > 0)
+    tot += n;
+  close(p[0]);
+  buf[tot] = 0;
+  if(strcmp(buf, "spawned\n") != 0){
+    printf("%s: wrong output %s\n", s, buf);
+    exit(1);
+  }
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: wait for spawned child failed\n", s);
+    exit(1);
+  }
+}
+
+// a pipe's buffer can be resized, and in gift mode whole pages
+// move in and out of it intact.
+void
+pipesize(char *s)
+{
+  enum { N = 8 };
+  char *p, *buf;
+  int fds[2], i, n, tot, gift;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[0], F_GETPIPE_SZ, 0) != 4096){
+    printf("%s: default pipe size wrong\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 5*4096) != N*4096){
+    printf("%s: F_SETPIPE_SZ didn't round up\n", s);
+    exit(1);
+  }
+  p = sbrk((N+1)*4096);
+  if(p == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  buf = (char*)(((uint64)p + 4095) & ~4095L);
+
+  // the reader always moves pages; the writer only the second time.
+  if(fcntl(fds[0], F_SETPIPE_GIFT, 1) != 0){
+    printf("%s: F_SETPIPE_GIFT failed\n", s);
+    exit(1);
+  }
+  for(gift = 0; gift < 2; gift++){
+    if(fcntl(fds[1], F_SETPIPE_GIFT, gift) != 0){
+      printf("%s: F_SETPIPE_GIFT failed\n", s);
+      exit(1);
+    }
+    for(i = 0; i < N*4096; i++)
+      buf[i] = (i + gift) % 251;
+    // the whole buffer fits with no one reading.
+    if(write(fds[1], buf, N*4096) != N*4096){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+    // a copying writer keeps its data; a gifting one gets the
+    // pages the reader put in the ring, zeroed.
+    for(i = 0; i < N*4096; i++){
+      if(buf[i] != (gift ? 0 : (char)((i + gift) % 251))){
+        printf("%s: writer's buffer changed at %d\n", s, i);
+        exit(1);
+      }
+    }
+    if(fcntl(fds[1], F_SETPIPE_SZ, 4096) != -1){
+      printf("%s: pipe shrank below its contents\n", s);
+      exit(1);
+    }
+    memset(buf, 'r', N*4096);  // goes to the ring; must not reach a writer
+    for(tot = 0; tot < N*4096; tot += n){
+      if((n = read(fds[0], buf + tot, N*4096 - tot)) <= 0){
+        printf("%s: read failed\n", s);
+        exit(1);
+      }
+    }
+    for(i = 0; i < N*4096; i++){
+      if(buf[i] != (char)((i + gift) % 251)){
+        printf("%s: wrong data at %d\n", s, i);
+        exit(1);
+      }
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  sbrk(-(N+1)*4096);
+}
+
 void
 writetest(char *s)
 {
@@ -569,10 +936,13 @@ writetest(char *s)
   }
 }
 
+// write a file that reaches into the double-indirect blocks.
+// (a MAXFILE-sized file wouldn't fit on the disk.)
 void
 writebig(char *s)
 {
   int i, fd, n;
+  enum { NBIG = NDIRECT + NINDIRECT + 2*NINDIRECT + 5 };
 
   fd = open("big", O_CREATE|O_RDWR);
   if(fd < 0){
@@ -580,7 +950,7 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < NBIG; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed\n", s, i);
@@ -600,7 +970,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != NBIG){
         printf("%s: read only %d blocks from big", s, n);
         exit(1);
       }
@@ -1553,6 +1923,74 @@ bigdir(char *s)
   }
 }
 
+// fill one bucket chain of the hashed root directory past a
+// block, and check that every name can be found, both by
+// lookup and by reading the directory as an array.
+void
+hashdir(char *s)
+{
+  enum { N = DPB + 10 };
+  char names[N][DIRSIZ];
+  struct dirent de;
+  uint h;
+  int i, j, n, fd, seen;
+
+  for(i = n = 0; n < N; i++){
+    names[n][0] = 'h';
+    names[n][1] = 'd';
+    names[n][2] = '0' + (i / 1000) % 10;
+    names[n][3] = '0' + (i / 100) % 10;
+    names[n][4] = '0' + (i / 10) % 10;
+    names[n][5] = '0' + i % 10;
+    names[n][6] = '\0';
+    h = 0;  // dirhash() in kernel/fs.c
+    for(j = 0; names[n][j]; j++)
+      h = h * 31 + (uchar)names[n][j];
+    if(h % NDIRBUCKET == 0)
+      n++;
+  }
+
+  for(i = 0; i < N; i++){
+    fd = open(names[i], O_CREATE|O_RDWR);
+    if(fd < 0){
+      printf("%s: create %s failed\n", s, names[i]);
+      exit(1);
+    }
+    close(fd);
+  }
+
+  for(i = 0; i < N; i++){
+    fd = open(names[i], O_RDONLY);
+    if(fd < 0){
+      printf("%s: open %s failed\n", s, names[i]);
+      exit(1);
+    }
+    close(fd);
+  }
+
+  fd = open("/", O_RDONLY);
+  seen = 0;
+  while(read(fd, &de, sizeof(de)) == sizeof(de))
+    if(de.inum != 0 && de.name[0] == 'h' && de.name[1] == 'd')
+      seen++;
+  close(fd);
+  if(seen != N){
+    printf("%s: read %d entries, wanted %d\n", s, seen, N);
+    exit(1);
+  }
+
+  for(i = 0; i < N; i++){
+    if(unlink(names[i]) != 0){
+      printf("%s: unlink %s failed\n", s, names[i]);
+      exit(1);
+    }
+    if(open(names[i], O_RDONLY) >= 0){
+      printf("%s: open of unlinked %s succeeded\n", s, names[i]);
+      exit(1);
+    }
+  }
+}
+
 void
 subdir(char *s)
 {
@@ -2654,6 +3092,341 @@ execout(char *s)
   exit(0);
 }
 
+// exec() from a process with more pages than fit in memory,
+// so that exec's own allocations push pages out to the swap
+// file. Each exec must give back all the log space it
+// reserved, or the file system eventually hangs.
+void
+execswap(char *s)
+{
+  int fd, xstatus;
+
+  for(int i = 0; i < 30; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      char *a = sbrk(20*PGSIZE);
+      if(a == (char*)-1){
+        printf("%s: sbrk failed\n", s);
+        exit(1);
+      }
+      for(int j = 0; j < 20; j++)
+        a[j*PGSIZE] = j;
+      close(1);
+      char *args[] = { "echo", "x", 0 };
+      exec("echo", args);
+      exit(1);
+    }
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: exec failed\n", s);
+      exit(1);
+    }
+  }
+
+  fd = open("execswap", O_CREATE|O_WRONLY);
+  if(fd < 0 || write(fd, "x", 1) != 1){
+    printf("%s: file system stuck after exec\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("execswap");
+  exit(0);
+}
+
+// Exit more processes with swap files at once than the swap
+// file pool keeps, twice, so that the second time some of the
+// files unlinked are ones reused from other processes. Only
+// the pooled files should be left in /.
+void
+swapfiles(char *s)
+{
+  enum { N = NSWAPFILE + 4 };
+  int ready[2], done[2], fd, i, n, xstatus;
+  struct dirent de;
+  char c;
+
+  for(int round = 0; round < 2; round++){
+    if(pipe(ready) < 0 || pipe(done) < 0){
+      printf("%s: pipe failed\n", s);
+      exit(1);
+    }
+    for(i = 0; i < N; i++){
+      int pid = fork();
+      if(pid < 0){
+        printf("%s: fork failed\n", s);
+        exit(1);
+      }
+      if(pid == 0){
+        close(ready[0]);
+        close(done[1]);
+        char *a = sbrk(20*PGSIZE);  // more than fit in memory
+        if(a == (char*)-1)
+          exit(1);
+        for(int j = 0; j < 20; j++)
+          a[j*PGSIZE] = j;
+        write(ready[1], "x", 1);
+        read(done[0], &c, 1);
+        exit(0);
+      }
+    }
+    close(ready[1]);
+    close(done[0]);
+    for(i = 0; i < N; i++)
+      read(ready[0], &c, 1);
+    close(ready[0]);
+    close(done[1]);  // now they all exit
+    for(i = 0; i < N; i++){
+      wait(&xstatus);
+      if(xstatus != 0){
+        printf("%s: child failed\n", s);
+        exit(1);
+      }
+    }
+  }
+
+  fd = open("/", O_RDONLY);
+  if(fd < 0){
+    printf("%s: open / failed\n", s);
+    exit(1);
+  }
+  n = 0;
+  while(read(fd, &de, sizeof(de)) == sizeof(de))
+    if(de.inum != 0 && memcmp(de.name, ".swap", 5) == 0)
+      n++;
+  close(fd);
+  if(n > NSWAPFILE){
+    printf("%s: %d swap files left in /\n", s, n);
+    exit(1);
+  }
+  exit(0);
+}
+
+// fork and reap a batch of children, and check that memstat()
+// accounts for every page-table page and trapframe they used.
+void
+memstattest(char *s)
+{
+  struct memstat st0, st1;
+
+  if(memstat(&st0) < 0){
+    printf("%s: memstat failed\n", s);
+    exit(1);
+  }
+  if(st0.free > st0.total || st0.peak < st0.total - st0.free){
+    printf("%s: inconsistent memstat\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < 10; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0)
+      exit(0);
+    wait(0);
+  }
+  if(memstat(&st1) < 0){
+    printf("%s: memstat failed\n", s);
+    exit(1);
+  }
+  if(st1.used[KMEM_PGTBL] != st0.used[KMEM_PGTBL] ||
+     st1.used[KMEM_TRAPFRAME] != st0.used[KMEM_TRAPFRAME]){
+    printf("%s: leaked page-table pages %d trapframes %d\n", s,
+           (int)(st1.used[KMEM_PGTBL] - st0.used[KMEM_PGTBL]),
+           (int)(st1.used[KMEM_TRAPFRAME] - st0.used[KMEM_TRAPFRAME]));
+    exit(1);
+  }
+  exit(0);
+}
+
+// lockstat() should count acquires of the "proc" locks,
+// and never report more contended acquires than acquires.
+void
+lockstattest(char *s)
+{
+  static struct lockstat st[32];
+  uint64 before = 0, after = 0;
+  int i, n;
+
+  n = lockstat(st, 32);
+  for(i = 0; i < n; i++){
+    if(st[i].ncontend > st[i].nacquire){
+      printf("%s: %s contended more than acquired\n", s, st[i].name);
+      exit(1);
+    }
+    if(strcmp(st[i].name, "proc") == 0)
+      before = st[i].nacquire;
+  }
+  if(fork() == 0)
+    exit(0);
+  wait(0);
+  n = lockstat(st, 32);
+  for(i = 0; i < n; i++)
+    if(strcmp(st[i].name, "proc") == 0)
+      after = st[i].nacquire;
+  if(after <= before){
+    printf("%s: proc lock acquires did not increase\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// schedstat() should report each CPU's run queue, refuse a
+// negative count, and count the switches to a batch of children.
+void
+schedstattest(char *s)
+{
+  static struct cpustat st[NCPU];
+  uint64 before = 0, after = 0;
+  int i, n, online = 0;
+
+  if(schedstat(st, -1) != -1){
+    printf("%s: schedstat accepted a negative count\n", s);
+    exit(1);
+  }
+  n = schedstat(st, NCPU);
+  if(n < 1 || n > NCPU){
+    printf("%s: schedstat returned %d\n", s, n);
+    exit(1);
+  }
+  for(i = 0; i < n; i++){
+    if(st[i].qlen < 0 || st[i].qlen > st[i].maxqlen){
+      printf("%s: cpu %d qlen %d maxqlen %d\n", s, i, st[i].qlen, (int)st[i].maxqlen);
+      exit(1);
+    }
+    online += st[i].online;
+    before += st[i].nsched;
+  }
+  if(online == 0){
+    printf("%s: no cpu online\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 10; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0)
+      exit(0);
+    wait(0);
+  }
+  n = schedstat(st, NCPU);
+  for(i = 0; i < n; i++)
+    after += st[i].nsched;
+  if(after < before + 10){
+    printf("%s: only %d switches for 10 children\n", s, (int)(after - before));
+    exit(1);
+  }
+  exit(0);
+}
+
+// setpriority() should refuse bad classes, out-of-range
+// priorities and nice values, and kernel or missing pids;
+// nice() should clamp to the legal range.
+void
+setprioritytest(char *s)
+{
+  int pid = getpid();
+
+  if(setpriority(pid, SCHED_PRIO, -1) != -1 ||
+     setpriority(pid, SCHED_PRIO, NPRIO) != -1 ||
+     setpriority(pid, SCHED_FAIR, NICE_MIN - 1) != -1 ||
+     setpriority(pid, SCHED_FAIR, NICE_MAX + 1) != -1 ||
+     setpriority(pid, -1, 0) != -1 ||
+     setpriority(pid, 2, 0) != -1 ||
+     setpriority(0, SCHED_FAIR, NICE_DEFAULT) != -1 ||
+     setpriority(-1, SCHED_FAIR, NICE_DEFAULT) != -1 ||
+     setpriority(0x7fffffff, SCHED_FAIR, NICE_DEFAULT) != -1){
+    printf("%s: setpriority accepted a bad argument\n", s);
+    exit(1);
+  }
+  if(setpriority(pid, SCHED_FAIR, NICE_MAX) != 0 || nice(0) != NICE_MAX){
+    printf("%s: setpriority did not set the nice value\n", s);
+    exit(1);
+  }
+  if(nice(100) != NICE_MAX || nice(-100) != NICE_MIN){
+    printf("%s: nice did not clamp\n", s);
+    exit(1);
+  }
+  if(setpriority(pid, SCHED_PRIO, NPRIO-1) != 0 ||
+     setpriority(pid, SCHED_FAIR, NICE_DEFAULT) != 0){
+    printf("%s: setpriority rejected a good argument\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// CPU hogs at nice NICE_MAX should get much less CPU than
+// hogs at the default nice value. Start several of each per
+// CPU, so that most run queues hold both kinds.
+void
+nicetest(char *s)
+{
+  static struct cpustat st[NCPU];
+  struct {
+    int niced;
+    uint64 n;
+  } r;
+  uint64 fair = 0, niced = 0;
+  int fds[2], i, n, xstatus, nhog = 0;
+  uint end;
+
+  n = schedstat(st, NCPU);
+  for(i = 0; i < n; i++)
+    nhog += 4 * st[i].online;
+  if(nhog < 4)
+    nhog = 4;
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  end = uptime() + 10;
+  for(i = 0; i < nhog; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      r.niced = i % 2;
+      if(r.niced && nice(NICE_MAX) != NICE_MAX)
+        exit(1);
+      for(r.n = 0; uptime() < end; r.n++)
+        ;
+      if(write(fds[1], &r, sizeof(r)) != sizeof(r))
+        exit(1);
+      exit(0);
+    }
+  }
+  close(fds[1]);
+  while(read(fds[0], &r, sizeof(r)) == sizeof(r)){
+    if(r.niced)
+      niced += r.n;
+    else
+      fair += r.n;
+  }
+  close(fds[0]);
+  for(i = 0; i < nhog; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: hog failed\n", s);
+      exit(1);
+    }
+  }
+  if(niced >= fair){
+    printf("%s: niced hogs looped %d times, others %d\n", s, (int)niced, (int)fair);
+    exit(1);
+  }
+  exit(0);
+}
+
 //
 // use sbrk() to count how many free physical memory pages there are.
 // touches the pages to force allocation.
@@ -2768,6 +3541,8 @@ main(int argc, char *argv[])
   } tests[] = {
     {manywrites, "manywrites"},
     {execout, "execout"},
+    {execswap, "execswap"},
+    {swapfiles, "swapfiles"},
     {copyin, "copyin"},
     {copyout, "copyout"},
     {copyinstr1, "copyinstr1"},
@@ -2782,6 +3557,18 @@ main(int argc, char *argv[])
     {sbrkbugs, "sbrkbugs" },
     // {badwrite, "badwrite" },
     {badarg, "badarg" },
+    {memstattest, "memstat" },
+    {lockstattest, "lockstat" },
+    {schedstattest, "schedstat" },
+    {setprioritytest, "setpriority" },
+    {nicetest, "nice" },
+    {fsynctest, "fsync" },
+    {dcachetest, "dcache" },
+    {hashdir, "hashdir" },
+    {mmaptest, "mmap" },
+    {textwrite, "textwrite" },
+    {spawntest, "spawn" },
+    {pipesize, "pipesize" },
     {reparent, "reparent" },
     {twochildren, "twochildren"},
     {forkfork, "forkfork"},
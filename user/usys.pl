@@ -36,3 +36,14 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("memstat");
+entry("schedstat");
+entry("setpriority");
+entry("nice");
+entry("lockstat");
+entry("fsync");
+entry("mmap");
+entry("munmap");
+entry("spawn");
+entry("fcntl");
+entry("logstat");